@@ -0,0 +1,49 @@
+#version 330 core
+
+in vec2 texcoord;
+
+out vec4 color;
+
+uniform vec2 u_resolution;
+uniform float u_time;
+
+// divergent control flow: neighbouring pixels take different branches and loop counts, which
+// GPUs execute in lockstep and have to serialize
+
+float hash(vec2 p) {
+    return fract(sin(dot(p, vec2(12.9898, 78.233))) * 43758.5453);
+}
+
+void main() {
+    vec2 cell = floor(texcoord * u_resolution / 4.0);
+    float h = hash(cell + floor(u_time));
+    float value = 0.0;
+
+    if (h < 0.25) {
+        for (int i = 0; i < int(h * 256.0); i++) {
+            value += sin(float(i) * h);
+        }
+    } else if (h < 0.5) {
+        value = fract(h * 17.0);
+        for (int i = 0; i < 16; i++) {
+            if (value > 0.5) {
+                value = value * value;
+            } else {
+                value = sqrt(value) + 0.1;
+            }
+        }
+    } else if (h < 0.75) {
+        vec2 p = texcoord * 8.0;
+        for (int i = 0; i < 32; i++) {
+            p = vec2(p.x * p.x - p.y * p.y, 2.0 * p.x * p.y) + vec2(h - 0.75, 0.1);
+            if (dot(p, p) > 4.0) {
+                break;
+            }
+            value += 1.0 / 32.0;
+        }
+    } else {
+        value = h;
+    }
+
+    color = vec4(vec3(fract(value)), 1.0);
+}
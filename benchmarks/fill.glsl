@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec2 texcoord;
+
+out vec4 color;
+
+uniform vec2 u_resolution;
+uniform float u_time;
+
+// fill rate bound: next to no work per pixel, so the cost is writing the pixels out
+
+void main() {
+    color = vec4(texcoord, 0.5 + 0.5 * sin(u_time), 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec2 texcoord;
+
+out vec4 color;
+
+uniform sampler2D u_channel0;
+
+// upload bound: a single lookup into a streamed channel, so the cost is getting a new frame
+// onto the texture for every frame drawn
+
+void main() {
+    color = texture(u_channel0, texcoord);
+}
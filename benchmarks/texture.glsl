@@ -0,0 +1,24 @@
+#version 330 core
+
+in vec2 texcoord;
+
+out vec4 color;
+
+uniform vec2 u_resolution;
+uniform float u_time;
+uniform sampler2D u_channel0;
+
+// texture bound: dependent lookups into an image at several scales, each reading a different
+// mip level, so the cost is in the texture units and memory rather than arithmetic
+
+void main() {
+    vec2 uv = texcoord;
+    vec4 sum = vec4(0.0);
+    for (int i = 0; i < 8; i++) {
+        vec4 texel = texture(u_channel0, uv * exp2(float(i) - 2.0) + u_time * 0.01);
+        sum += texel;
+        // where the next lookup goes depends on this one
+        uv += (texel.rg - 0.5) * 0.05;
+    }
+    color = vec4(sum.rgb / 8.0, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+
+in vec2 texcoord;
+
+out vec4 color;
+
+uniform vec2 u_resolution;
+
+// written by example/feed_writer.c
+layout(std140) uniform glshell_feed {
+    float cpu;
+    // hours, minutes, seconds
+    vec4 clock;
+};
+
+void main() {
+    // CPU usage as a bar across the surface, the seconds as a thin line under it
+    float bar = step(texcoord.x, cpu);
+    float seconds = step(texcoord.x, clock.z / 60.0) * step(0.9, texcoord.y);
+    color = vec4(mix(vec3(0.2, 0.6, 1.0), vec3(1.0), seconds), max(bar * 0.6, seconds));
+}
@@ -0,0 +1,65 @@
+// feeds CPU usage and the time of day to a glshell started with --feed /glshell-example, e.g.
+// glshell example/feed.glsl -h 30 -a top:middle -r -l top --feed /glshell-example
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "glshell_feed.h"
+
+static int read_cpu(unsigned long long* busy, unsigned long long* total) {
+    FILE* file = fopen("/proc/stat", "r");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned long long user, nice, system, idle, iowait, irq, softirq;
+    int fields = fscanf(
+        file,
+        "cpu %llu %llu %llu %llu %llu %llu %llu",
+        &user,
+        &nice,
+        &system,
+        &idle,
+        &iowait,
+        &irq,
+        &softirq
+    );
+    fclose(file);
+    if (fields != 7) {
+        return 0;
+    }
+    *busy = user + nice + system + irq + softirq;
+    *total = *busy + idle + iowait;
+    return 1;
+}
+
+int main(void) {
+    glshell_feed_t* feed = glshell_feed_open("/glshell-example");
+    if (feed == NULL) {
+        printf("unable to open the feed\n");
+        return 1;
+    }
+
+    unsigned long long last_busy = 0;
+    unsigned long long last_total = 0;
+    for (;;) {
+        unsigned long long busy;
+        unsigned long long total;
+        float cpu = 0.0f;
+        if (read_cpu(&busy, &total) && total > last_total) {
+            cpu = (float)(busy - last_busy) / (total - last_total);
+            last_busy = busy;
+            last_total = total;
+        }
+
+        time_t now = time(NULL);
+        struct tm* local = localtime(&now);
+
+        // both change in one update, the shader never sees one without the other
+        glshell_feed_begin(feed);
+        glshell_feed_put(feed, "cpu", cpu, 0.0f, 0.0f, 0.0f);
+        glshell_feed_put(feed, "clock", local->tm_hour, local->tm_min, local->tm_sec, 0.0f);
+        glshell_feed_end(feed);
+
+        sleep(1);
+    }
+}
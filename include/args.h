@@ -12,9 +12,40 @@ typedef struct args {
     bool reserve;
     enum zwlr_layer_shell_v1_layer layer;
     char* output_name;
+    bool all_outputs;
+    bool opaque;
+    float render_scale;
+    bool headless;
+    bool render_thread;
 
     // specific to this example
+    // NULL for a daemon started without an overlay
     char* fragment_shader;
+    bool has_damage;
+    int damage[4];
+    float frame_budget;
+    // milliseconds between timer driven frames, 0 to follow frame callbacks
+    float interval;
+    bool stats;
+    int frames;
+    float duration;
+    char* json;
+    char* export_directory;
+    float fps;
+    char* format;
+    float bake_loop;
+    float bake_max_mb;
+    bool watch;
+    // <name>=<path>[,<option>...] (stb_ds array)
+    char** passes;
+    // <n>=<path> (stb_ds array)
+    char** channels;
+    char* feed;
+    // keep running, creating and changing overlays as commands arrive on a socket
+    bool daemon;
 } args_t;
 
 args_t args_parse(int argc, char* argv[]);
+// the options that describe a surface, also those of the daemon's create command. advances i
+// past the option's value, false if argv[*i] isn't one of them or its value is invalid
+bool args_parse_surface(args_t* args, int argc, char* argv[], int* i);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include "cache.h"
+
+// draws the shader at `time` into the bound framebuffer, at width x height
+typedef void (*bake_draw_fn)(void* data, float time, int width, int height);
+
+// one period of a looping shader, rendered once into a texture array. playing it back is a
+// single blit per frame
+typedef struct bake {
+    GLuint texture;
+    GLuint framebuffer;
+    int width;
+    int height;
+    int frames;
+    float period;
+    // the layer attached to the framebuffer, -1 for none
+    int layer;
+
+    // frames are rendered, or read from the cache, a few per frame drawn rather than all at
+    // once. then rendered ones are written to the cache a few at a time
+    int baked;
+    int saved;
+    FILE* cache;
+    cache_writer_t writer;
+    bool saving;
+    uint64_t key;
+    char name[32];
+    double start;
+} bake_t;
+
+// sets up a bake at width x height, smaller if the frames would take more than max_bytes of
+// GPU memory. false if they don't fit even then, or at all
+bool bake_create(
+    bake_t* bake,
+    const char* fragment_shader,
+    float period,
+    int frames,
+    int width,
+    int height,
+    size_t max_bytes
+);
+// renders or loads the next few frames, and saves a few once all are there. true once every
+// frame is, until then the shader has to be drawn live
+bool bake_step(bake_t* bake, bake_draw_fn draw, void* data);
+// copies the frame for `time` into the bound framebuffer, scaled to width x height
+void bake_play(bake_t* bake, float time, int width, int height);
+void bake_destroy(bake_t* bake);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 64-bit FNV-1a, chain calls starting from CACHE_HASH_INIT
+#define CACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+uint64_t cache_hash(uint64_t hash, const void* data, size_t size);
+uint64_t cache_hash_string(uint64_t hash, const char* string);
+
+// entries live in $XDG_CACHE_HOME/glshell (or ~/.cache/glshell)
+char* cache_path(const char* name);
+void* cache_read(const char* name, size_t* size);
+bool cache_write(const char* name, const void* data, size_t size);
+
+// for entries too large to hold in memory at once. a written entry only appears once
+// committed, discarded if ok is false
+typedef struct cache_writer {
+    FILE* file;
+    char* path;
+    char* tmp_path;
+} cache_writer_t;
+
+FILE* cache_open(const char* name);
+bool cache_begin_write(const char* name, cache_writer_t* writer);
+bool cache_commit(cache_writer_t* writer, bool ok);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include "glshell.h"
+#include "stream.h"
+
+#define CHANNEL_COUNT 8
+// texture unit of channel n, clear of the ones the render graph hands out
+#define CHANNEL_UNIT(n) (32 + (n))
+
+// an image sampled as u_channel<n>, decoded on a thread of its own, or a stream of frames
+typedef struct channel {
+    char* path;
+    pthread_t thread;
+    // set by the thread: RGBA pixels, or the reason there are none
+    unsigned char* pixels;
+    int width;
+    int height;
+    const char* error;
+    float decode_ms;
+    bool decoded;
+    GLuint texture;
+    stream_t* stream;
+} channel_t;
+
+typedef struct channels {
+    // path is NULL for unused channels
+    channel_t channels[CHANNEL_COUNT];
+    pthread_mutex_t mutex;
+    pthread_cond_t decoded;
+    // signalled by the threads when an image is decoded
+    int event;
+    // the instance that draws them, from channels_init_gl()
+    glshell_t* glshell;
+    // channels whose texture changed since channels_take_changed(), bit n for channel n
+    uint32_t changed;
+} channels_t;
+
+// specs are <n>=<path>, Y4M files and image sequences are streamed. starts decoding right
+// away, before there is a GL context, exits if a spec is malformed or an image isn't a PNG or
+// JPEG
+channels_t* channels_load(char** specs);
+// images are uploaded from glshell_dispatch_pending() as they finish decoding, until then their
+// channels sample black, as do those of images that fail to decode
+void channels_init_gl(channels_t* channels, glshell_t* glshell);
+// blocks until every image is uploaded and makes streams wait for each frame rather than drop
+// late ones, for output that has to be the same every run
+void channels_wait(channels_t* channels);
+// shows the frame of each stream for `time`, before drawing. streams that uploaded a frame
+// count as changed for channels_take_changed()
+void channels_update(channels_t* channels, float time);
+// true if there are streams, which change without the surface changing
+bool channels_animated(channels_t* channels);
+// stream upload statistics, for --stats and --json
+void channels_print_stats(channels_t* channels);
+void channels_write_json(channels_t* channels, FILE* file);
+// the channels whose texture changed since the last call, bit n for channel n. render graph
+// passes sampling them have to be drawn again
+uint32_t channels_take_changed(channels_t* channels);
+// points the u_channel<n> samplers of program at the channel textures, leaving it bound.
+// returns the channels it samples, bit n for channel n
+uint32_t channels_link(channels_t* channels, GLuint program);
+void channels_destroy(channels_t* channels);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+// readbacks in flight, a frame is only mapped once the GPU is this many frames further along
+#define EXPORT_PBOS 4
+// frames waiting for a worker, per worker, before capturing blocks
+#define EXPORT_QUEUE_PER_THREAD 2
+
+typedef enum export_format {
+    EXPORT_FORMAT_RGBA,
+    EXPORT_FORMAT_PPM,
+    EXPORT_FORMAT_PAM,
+    EXPORT_FORMAT_Y4M,
+} export_format_t;
+
+struct export_job {
+    int frame;
+    // bottom up RGBA, as read back
+    uint8_t* pixels;
+};
+
+// writes rendered frames to disk. readback goes through a ring of pixel buffer objects, and a
+// pool of worker threads flips, converts and writes the frames
+typedef struct exporter {
+    char* directory;
+    export_format_t format;
+    int width;
+    int height;
+    float fps;
+
+    // y4m goes into one file, every frame at a fixed offset so workers can write in any order
+    int file;
+    size_t header_size;
+    size_t frame_size;
+
+    GLuint pbos[EXPORT_PBOS];
+    GLsync fences[EXPORT_PBOS];
+    // frame in each pixel buffer, -1 if it is free
+    int pbo_frames[EXPORT_PBOS];
+    int pbo_next;
+
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_taken;
+    struct export_job* jobs;
+    int job_capacity;
+    int job_first;
+    int job_count;
+    bool done;
+    bool failed;
+    // RGBA frames no job uses anymore, stb_ds array
+    uint8_t** free_buffers;
+
+    int frames;
+} exporter_t;
+
+bool export_parse_format(const char* name, export_format_t* format);
+// exits if the directory or the y4m file can't be created
+exporter_t* exporter_create(
+    const char* directory,
+    export_format_t format,
+    int width,
+    int height,
+    float fps
+);
+// starts reading back the bound framebuffer, call after drawing the frame
+void exporter_capture(exporter_t* exporter, int frame);
+// waits for every frame to be written and frees the exporter, false if any write failed
+bool exporter_finish(exporter_t* exporter);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include "glshell_feed.h"
+
+// the uniform buffer binding the glshell_feed block is read from
+#define FEED_BINDING 0
+
+// a member of a program's glshell_feed block
+typedef struct feed_member {
+    char name[GLSHELL_FEED_NAME_LENGTH];
+    GLint offset;
+    int components;
+} feed_member_t;
+
+// reads a glshell_feed.h segment into a uniform buffer
+typedef struct feed {
+    const glshell_feed_t* shared;
+    // sequence number of the values in the buffer
+    uint32_t sequence;
+    bool stale;
+    glshell_feed_value_t values[GLSHELL_FEED_VALUES];
+
+    // readable whenever a writer ended an update, -1 unless opened to wake. a thread sleeps on
+    // the sequence number's futex and writes to it
+    int wakeup;
+    pthread_t waiter;
+    atomic_bool stop;
+
+    GLuint buffer;
+    // the block as the programs lay it out (stb_ds arrays)
+    feed_member_t* members;
+    unsigned char* block;
+} feed_t;
+
+// name is a POSIX shared memory name, or fd:<n> for an inherited descriptor such as a memfd.
+// the segment is only read, a writer has to create it first. exits if it can't be mapped. with
+// wake, feed->wakeup tells when writers publish
+feed_t* feed_open(const char* name, bool wake);
+// forgets the layout, before the programs are linked again
+void feed_reset(feed_t* feed);
+// binds the glshell_feed block of program if it has one, true if it does
+bool feed_link(feed_t* feed, GLuint program);
+// true if a writer published values feed_update() hasn't copied yet, a single atomic load
+bool feed_changed(feed_t* feed);
+// copies the values into the buffer if a writer changed them, true if it did. no locks or
+// syscalls, an update in progress is picked up on a later frame
+bool feed_update(feed_t* feed);
+void feed_destroy(feed_t* feed);
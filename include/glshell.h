@@ -1,8 +1,13 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wlr-layer-shell-unstable-v1-client-protocol.h>
 
+// one set of layer surfaces and its frame loop. instances created with the same params.share
+// use the same compositor connection, EGL context and objects made in it
+typedef struct glshell_state glshell_t;
+
 typedef struct glshell_params {
     int width;
     int height;
@@ -11,15 +16,98 @@ typedef struct glshell_params {
     bool reserve;
     enum zwlr_layer_shell_v1_layer layer;
     char* output_name;
+    bool all_outputs;
+    bool opaque;
+    // fraction of the output's pixel density to render at, the compositor scales it up
+    float render_scale;
+    // no compositor: render into an offscreen width x height framebuffer, which is bound for
+    // each frame in place of the default one
+    bool headless;
+    // dispatch compositor events on a thread of their own, so configures are taken in while a
+    // frame is drawn. glshell_* calls still belong on the thread that called glshell_create().
+    // taken from the first instance of a display
+    bool render_thread;
+    // an existing instance to share the connection and EGL context with, or NULL for a display
+    // of its own. the EGL config is the first instance's, and headless instances only share
+    // with each other
+    glshell_t* share;
+    // no surfaces, only the display: a handle for other instances to share, which keeps the
+    // connection and the context alive while none exist. the context is left current without
+    // a surface, which needs EGL_KHR_surfaceless_context
+    bool no_surfaces;
 } glshell_params_t;
 
-void glshell_init(glshell_params_t*);
-void glshell_swap_buffers(void);
-bool glshell_poll_events(void);
-void glshell_cleanup(void);
-void glshell_stop(void);
+typedef struct glshell_rect {
+    int x;
+    int y;
+    int width;
+    int height;
+} glshell_rect_t;
+
+typedef struct glshell_stats {
+    uint64_t frames;
+    uint64_t wakeups;
+    float elapsed;
+    // CPU time of the whole process, in seconds
+    float cpu_time;
+    // configures answered with a frame, and how long after the event the frame was swapped,
+    // in milliseconds
+    uint64_t configures;
+    float configure_latency_mean;
+    float configure_latency_max;
+} glshell_stats_t;
+
+typedef void (*glshell_fd_callback_t)(void* data);
+
+// NULL if the named output doesn't exist
+glshell_t* glshell_create(glshell_params_t*);
+// picks the next surface that wants a frame and makes it current, false if there is none
+bool glshell_begin_frame(glshell_t*);
+// mark a rectangle of the surface (in pixels, top left origin) as changed in the frame being
+// drawn. if nothing is added, the whole surface counts as damaged
+void glshell_add_damage(glshell_t*, int x, int y, int width, int height);
+// the area that has to be redrawn in the current back buffer, in GL window coordinates
+// (bottom left origin), suitable for glScissor
+glshell_rect_t glshell_get_repaint_region(glshell_t*);
+void glshell_swap_buffers(glshell_t*);
+// waits for and dispatches events, false once glshell_stop() was called or the connection is
+// lost. the same as glshell_flush(), then poll() on glshell_get_fd(), then
+// glshell_dispatch_pending()
+bool glshell_poll_events(glshell_t*);
+// for an application's own event loop: a file descriptor that becomes readable when the
+// compositor sent events or a watched fd is readable. it never has to be read from. instances
+// sharing a display share it, flush and dispatch once through any one of them
+int glshell_get_fd(glshell_t*);
+// call before sleeping on glshell_get_fd(): dispatches events already queued, then sends the
+// requests made since. every call has to be followed by glshell_dispatch_pending()
+bool glshell_flush(glshell_t*);
+// call after waking up: reads what the compositor sent, runs the callbacks of readable
+// watches and dispatches the events. returns as glshell_poll_events() does
+bool glshell_dispatch_pending(glshell_t*);
+void glshell_set_continuous(glshell_t*, bool);
+// draw every ms milliseconds, on multiples of it on the wall clock, instead of on each frame
+// callback. a tick asks for a frame callback and draws when it arrives, between ticks nothing
+// but protocol events wakes glshell_get_fd(). exits if ms is below 1
+void glshell_set_interval(glshell_t*, float ms);
+// draw every surface again, e.g. after the program changed
+void glshell_redraw(glshell_t*);
+// also wake glshell_get_fd() when fd is readable, calling back from
+// glshell_dispatch_pending(). an fd has to be unwatched before it is closed
+void glshell_watch_fd(glshell_t*, int fd, glshell_fd_callback_t callback, void* data);
+void glshell_unwatch_fd(glshell_t*, int fd);
+// a second context sharing objects with the one frames are drawn with, to build them on another
+// thread. false if the driver can't make it current without a surface. the thread using it has
+// to release it before the last glshell_destroy()
+bool glshell_create_shared_context(glshell_t*);
+bool glshell_make_shared_context_current(glshell_t*);
+void glshell_release_shared_context(glshell_t*);
+void glshell_get_stats(glshell_t*, glshell_stats_t*);
+// the display goes with the last instance sharing it
+void glshell_destroy(glshell_t*);
+void glshell_stop(glshell_t*);
 
-float glshell_get_delta_time(void);
-float glshell_get_time(void);
-float glshell_get_width(void);
-float glshell_get_height(void);
+float glshell_get_delta_time(glshell_t*);
+float glshell_get_time(glshell_t*);
+// of the surface being drawn or drawn last, 0 with no_surfaces or once it is destroyed
+float glshell_get_width(glshell_t*);
+float glshell_get_height(glshell_t*);
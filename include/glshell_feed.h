@@ -0,0 +1,164 @@
+#pragma once
+
+// values for glshell shaders from other processes, through a shared memory segment given to
+// glshell with --feed. a shader reads them by declaring
+//
+//     layout(std140) uniform glshell_feed {
+//         float cpu;
+//         vec4 battery;
+//     };
+//
+// where each member takes the value of the same name. writers only need this header:
+//
+//     glshell_feed_t* feed = glshell_feed_open("/bar");
+//     glshell_feed_set(feed, "cpu", 0.25f, 0.0f, 0.0f, 0.0f);
+//
+// updates go through a seqlock: the sequence number is odd while a writer changes the block,
+// so readers never wait and never see half an update. only one process should write. ending an
+// update wakes readers sleeping on the sequence number with a futex, one syscall per update
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define GLSHELL_FEED_MAGIC 0x64656566687367ULL
+#define GLSHELL_FEED_VERSION 2
+#define GLSHELL_FEED_VALUES 64
+#define GLSHELL_FEED_NAME_LENGTH 32
+
+typedef struct glshell_feed_value {
+    char name[GLSHELL_FEED_NAME_LENGTH];
+    float value[4];
+} glshell_feed_value_t;
+
+typedef struct glshell_feed {
+    uint64_t magic;
+    uint32_t version;
+    _Atomic uint32_t sequence;
+    uint32_t count;
+    uint32_t reserved;
+    glshell_feed_value_t values[GLSHELL_FEED_VALUES];
+} glshell_feed_t;
+
+// maps a segment, which may be a memfd, creating the block if it is empty. NULL on errors
+static inline glshell_feed_t* glshell_feed_map(int fd) {
+    if (ftruncate(fd, sizeof(glshell_feed_t)) == -1) {
+        return NULL;
+    }
+    void* feed = mmap(NULL, sizeof(glshell_feed_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return feed == MAP_FAILED ? NULL : feed;
+}
+
+// opens or creates the POSIX shared memory object name, e.g. "/bar" for /dev/shm/bar
+static inline glshell_feed_t* glshell_feed_open(const char* name) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    glshell_feed_t* feed = glshell_feed_map(fd);
+    close(fd);
+    return feed;
+}
+
+// maps a segment for reading only, without creating or resizing it. NULL if it is smaller than
+// the block or was set up by a writer of another version, an empty block is filled in later
+static inline const glshell_feed_t* glshell_feed_map_readonly(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(glshell_feed_t)) {
+        return NULL;
+    }
+    void* mapping = mmap(NULL, sizeof(glshell_feed_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    const glshell_feed_t* feed = mapping;
+    if (feed->magic == GLSHELL_FEED_MAGIC && feed->version != GLSHELL_FEED_VERSION) {
+        munmap(mapping, sizeof(glshell_feed_t));
+        return NULL;
+    }
+    return feed;
+}
+
+// opens an existing POSIX shared memory object for reading, the writer has to create it
+static inline const glshell_feed_t* glshell_feed_open_readonly(const char* name) {
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    const glshell_feed_t* feed = glshell_feed_map_readonly(fd);
+    close(fd);
+    return feed;
+}
+
+// several values can be set as one update between begin and end
+static inline void glshell_feed_begin(glshell_feed_t* feed) {
+    uint32_t sequence = atomic_load_explicit(&feed->sequence, memory_order_relaxed);
+    atomic_store_explicit(&feed->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    if (feed->magic != GLSHELL_FEED_MAGIC) {
+        feed->magic = GLSHELL_FEED_MAGIC;
+        feed->version = GLSHELL_FEED_VERSION;
+        feed->count = 0;
+    }
+}
+
+static inline void glshell_feed_end(glshell_feed_t* feed) {
+    uint32_t sequence = atomic_load_explicit(&feed->sequence, memory_order_relaxed);
+    atomic_store_explicit(&feed->sequence, sequence + 1, memory_order_release);
+    syscall(SYS_futex, &feed->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// false if the block is full
+static inline bool glshell_feed_put(
+    glshell_feed_t* feed,
+    const char* name,
+    float x,
+    float y,
+    float z,
+    float w
+) {
+    uint32_t i = 0;
+    while (i < feed->count &&
+           strncmp(feed->values[i].name, name, GLSHELL_FEED_NAME_LENGTH) != 0) {
+        i++;
+    }
+    if (i == GLSHELL_FEED_VALUES) {
+        return false;
+    }
+    if (i == feed->count) {
+        strncpy(feed->values[i].name, name, GLSHELL_FEED_NAME_LENGTH - 1);
+        feed->count++;
+    }
+    feed->values[i].value[0] = x;
+    feed->values[i].value[1] = y;
+    feed->values[i].value[2] = z;
+    feed->values[i].value[3] = w;
+    return true;
+}
+
+// a single value as an update of its own, floats only use x
+static inline bool glshell_feed_set(
+    glshell_feed_t* feed,
+    const char* name,
+    float x,
+    float y,
+    float z,
+    float w
+) {
+    glshell_feed_begin(feed);
+    bool ok = glshell_feed_put(feed, name, x, y, z, w);
+    glshell_feed_end(feed);
+    return ok;
+}
+
+static inline void glshell_feed_close(const glshell_feed_t* feed) {
+    munmap((void*)feed, sizeof(glshell_feed_t));
+}
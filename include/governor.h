@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <GL/glew.h>
+
+// timer queries in flight, results are read a few frames late so reading them never stalls
+#define GOVERNOR_QUERIES 4
+
+// renders into an offscreen framebuffer at a fraction of the surface resolution, picked to
+// keep the GPU time of a frame within budget
+typedef struct governor {
+    // milliseconds of GPU time a frame may take
+    float budget;
+    float scale;
+    int render_width;
+    int render_height;
+
+    // allocated at the largest size seen, frames only use the bottom left part of it
+    GLuint framebuffer;
+    GLuint texture;
+    // whatever was bound when the frame began, the scaled frame goes there
+    GLuint target;
+    int texture_width;
+    int texture_height;
+
+    // timestamps around each frame, which unlike GL_TIME_ELAPSED drivers such as llvmpipe
+    // also report meaningfully
+    GLuint queries[GOVERNOR_QUERIES][2];
+    int query_first;
+    int query_count;
+    bool query_active;
+
+    // smoothed GPU time in milliseconds, and the state of the hysteresis
+    float gpu_time;
+    int samples;
+    int settle;
+    int over;
+    int under;
+} governor_t;
+
+void governor_init(governor_t* governor, float budget);
+// binds the offscreen framebuffer, draw at render_width x render_height afterwards
+void governor_begin(governor_t* governor, int width, int height);
+// scales the frame up into the framebuffer that was bound before, and binds it again
+void governor_end(governor_t* governor, int width, int height);
+void governor_destroy(governor_t* governor);
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+// fixed rate passes that fell further behind than this skip the missed steps
+#define GRAPH_MAX_STEPS 4
+
+// a sampler uniform reading a pass: u_pass_<name> for its latest output, u_prev_<name> for the
+// output of the frame before
+typedef struct graph_input {
+    int pass;
+    bool previous;
+} graph_input_t;
+
+// a float uniform u_alpha_<name>, how far the frame is between the last two steps of a fixed
+// rate pass
+typedef struct graph_alpha {
+    GLint location;
+    int pass;
+} graph_alpha_t;
+
+// a fragment shader rendering into textures of its own, which the passes after it and the
+// final shader sample
+typedef struct graph_pass {
+    char* name;
+    char* path;
+    char* source;
+    // size relative to the frame, and texture format and sampling
+    float scale;
+    GLenum format;
+    GLint filter;
+    GLint wrap;
+    // steps per second for simulations, 0 to draw along with the frames
+    float rate;
+
+    GLuint program;
+    GLint u_time;
+    GLint u_resolution;
+    bool uses_time;
+    // bound to texture units in order (stb_ds arrays)
+    graph_input_t* inputs;
+    graph_alpha_t* alphas;
+
+    // ping-pong pair, a pass writes one while the other still holds its previous output
+    GLuint textures[2];
+    GLuint framebuffers[2];
+    int current;
+    int previous;
+    int width;
+    int height;
+    // the frame the pass was last drawn in, 0 if its textures hold nothing yet
+    uint64_t drawn;
+    // channels the pass samples, bit n for u_channel<n>, whether it reads the glshell_feed
+    // block, and whether one of them changed since the pass was drawn
+    uint32_t channels;
+    bool feed;
+    bool stale;
+    // fixed rate passes: u_time of the last step, and how far the frame is towards the next
+    float step_time;
+    float alpha;
+} graph_pass_t;
+
+typedef struct graph {
+    // in drawing order (stb_ds array)
+    graph_pass_t* passes;
+    // the shader drawing the frame, and the passes it samples (stb_ds arrays)
+    GLuint output_program;
+    graph_input_t* output_inputs;
+    graph_alpha_t* output_alphas;
+    uint64_t frame;
+} graph_t;
+
+// spec is <name>=<path>[,scale=<factor>][,format=<format>][,filter=<filter>][,wrap=<wrap>]
+// [,rate=<hz>], exits if it is malformed or the shader doesn't build
+void graph_add_pass(graph_t* graph, const char* spec, const char* vertex_shader);
+// the program that draws the frame from the passes after graph_render(), 0 for none. call
+// once every pass is added
+void graph_use_program(graph_t* graph, GLuint program);
+// true if passes change without the surface changing, so frames have to be drawn continuously
+bool graph_animated(graph_t* graph);
+// passes sampling any of channels (bit n for u_channel<n>) are drawn again by the next
+// graph_render(), for textures that changed outside the graph
+void graph_invalidate_channels(graph_t* graph, uint32_t channels);
+// passes reading the feed are drawn again by the next graph_render(), once it has new values
+void graph_invalidate_feed(graph_t* graph);
+// draws the passes whose inputs changed at sizes relative to width x height and binds their
+// textures for the output program. the bound framebuffer, viewport and program are restored
+void graph_render(graph_t* graph, float time, int width, int height);
+void graph_destroy(graph_t* graph);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// PNG and JPEG decoding to RGBA. both return NULL and set *error to the reason if the image
+// can't be decoded
+unsigned char* image_load(const char* path, int* width, int* height, const char** error);
+unsigned char* image_load_from_memory(
+    const unsigned char* data,
+    size_t size,
+    int* width,
+    int* height,
+    const char** error
+);
+bool image_info(const char* path, int* width, int* height);
+void image_free(unsigned char* pixels);
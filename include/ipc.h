@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "glshell.h"
+
+// longest command line a client may send
+#define IPC_LINE_MAX 4096
+// words of a command, anything past them is dropped
+#define IPC_ARGS_MAX 32
+
+typedef struct ipc_client {
+    int fd;
+    // bytes received since the last complete line (stb_ds array)
+    char* buffer;
+} ipc_client_t;
+
+// one command line, split into words. every command gets exactly one line back, through
+// ipc_reply()
+typedef void (*ipc_command_fn)(void* data, ipc_client_t* client, int argc, char** argv);
+
+// a Unix socket taking newline separated commands, from any number of clients. commands run
+// on the render thread, from glshell_dispatch_pending()
+typedef struct ipc_server {
+    glshell_t* glshell;
+    char* path;
+    int socket;
+    // the socket and every client, so that glshell only watches one fd
+    int epoll;
+    ipc_client_t** clients;
+    ipc_command_fn command;
+    void* data;
+} ipc_server_t;
+
+// listens on $XDG_RUNTIME_DIR/glshell.sock. exits if it can't, or if another daemon already
+// answers there
+ipc_server_t* ipc_server_create(glshell_t* glshell, ipc_command_fn command, void* data);
+void ipc_reply(ipc_client_t* client, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+void ipc_server_destroy(ipc_server_t* server);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// a lock-free ring of fixed size items between exactly one producer and one consumer thread.
+// event is an eventfd that becomes readable once something was pushed, for the consumer to
+// sleep on
+typedef struct mailbox {
+    char* items;
+    size_t item_size;
+    // a power of two
+    size_t capacity;
+    // the next item to pop, only written by the consumer
+    _Atomic size_t head;
+    // the next slot to push to, only written by the producer
+    _Atomic size_t tail;
+    int event;
+} mailbox_t;
+
+// exits if the eventfd can't be created
+void mailbox_init(mailbox_t* mailbox, size_t item_size, size_t capacity);
+// false if the consumer is too far behind and the ring is full
+bool mailbox_push(mailbox_t* mailbox, const void* item);
+// false if it is empty. also resets the event once everything was taken
+bool mailbox_pop(mailbox_t* mailbox, void* item);
+void mailbox_destroy(mailbox_t* mailbox);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <GL/glew.h>
+
+#include "glshell.h"
+
+// receives a newly linked program and the source it was built from, both owned by the callee
+typedef void (*reload_fn)(void* data, GLuint program, char* fragment_shader);
+
+// watches the fragment shader file and rebuilds the program whenever it changes. building
+// happens on a worker thread with a shared context, so drawing never waits for the compiler
+typedef struct reloader {
+    char* path;
+    char* name;
+    const char* vertex_shader;
+    reload_fn reload;
+    void* data;
+    // whose context the programs are built for
+    glshell_t* glshell;
+
+    int inotify;
+    // signalled by the worker once a program is ready
+    int event;
+
+    // without a shared context, changes are built on the render thread instead, stalling its
+    // frames while the driver compiles. fallback is set by a worker that couldn't make the
+    // shared context current and stopped
+    bool threaded;
+    bool fallback;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t source_ready;
+    // the latest source waiting to be built, and the latest program waiting to be used
+    char* source;
+    GLuint program;
+    char* program_source;
+    bool stop;
+} reloader_t;
+
+// exits if the file can't be watched
+reloader_t* reloader_create(
+    glshell_t* glshell,
+    const char* path,
+    const char* vertex_shader,
+    reload_fn reload,
+    void* data
+);
+void reloader_destroy(reloader_t* reloader);
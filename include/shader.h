@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include <GL/glew.h>
+
+// how a program was obtained, for benchmarks
+typedef struct shader_load_info {
+    // time spent in shader_program_load
+    float load_ms;
+    // time building from source took, recorded in the cache entry if it was loaded from there
+    float compile_ms;
+    bool cached;
+} shader_load_info_t;
+
+// both return 0 and log the reason if the program can't be built
+GLuint shader_program_create(const char* vertex_shader, const char* fragment_shader);
+// like shader_program_create, but goes through the on-disk program binary cache. info may be
+// NULL, and is zeroed if building fails
+GLuint shader_program_load(
+    const char* vertex_shader,
+    const char* fragment_shader,
+    shader_load_info_t* info
+);
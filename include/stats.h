@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+// frames whose GPU time may still be pending, results are only read once available
+#define FRAME_STATS_QUERIES 8
+
+// wall clock time between frames, and the CPU and GPU time of each, summarized as percentiles
+typedef struct frame_stats {
+    // milliseconds, stb_ds arrays
+    float* frame_times;
+    float* cpu_times;
+    float* gpu_times;
+
+    double last_frame;
+    double cpu_start;
+    // timestamp pairs, like the governor's
+    GLuint queries[FRAME_STATS_QUERIES][2];
+    int query_first;
+    int query_count;
+    bool query_active;
+} frame_stats_t;
+
+void frame_stats_init(frame_stats_t* stats);
+void frame_stats_begin(frame_stats_t* stats);
+void frame_stats_end(frame_stats_t* stats);
+// waits for the GPU times still pending, then prints the percentiles of both
+void frame_stats_print(frame_stats_t* stats);
+// the same as members of a JSON object, "frame_ms": {"mean": ..., "p50": ...}, "cpu_ms": ...
+void frame_stats_write_json(frame_stats_t* stats, FILE* file);
+void frame_stats_destroy(frame_stats_t* stats);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+// frames decoded ahead of the one on screen
+#define STREAM_SLOTS 4
+
+typedef enum stream_slot_state {
+    // the worker may decode into it
+    STREAM_SLOT_FREE,
+    STREAM_SLOT_DECODING,
+    STREAM_SLOT_READY,
+    // copied into the texture, free once the fence signals
+    STREAM_SLOT_UPLOADING,
+} stream_slot_state_t;
+
+typedef struct stream_slot {
+    stream_slot_state_t state;
+    int64_t frame;
+    unsigned char* pixels;
+    GLsync fence;
+} stream_slot_t;
+
+// frames of a Y4M file or a numbered image sequence, played in a loop on a texture. a worker
+// thread converts them to RGBA ahead of time into a ring of slots, which are persistently
+// mapped pixel buffers where the driver supports them
+typedef struct stream {
+    char* path;
+    int width;
+    int height;
+    float fps;
+    int frame_count;
+
+    // Y4M: the mapped file and the offset of each frame's planes (stb_ds array)
+    unsigned char* data;
+    size_t size;
+    size_t* frames;
+    int chroma_width;
+    int chroma_height;
+    // image sequences: the name around its frame number, zero padded or not to digits, numbered
+    // from first
+    char* prefix;
+    char* suffix;
+    int digits;
+    bool zero_pad;
+    int first;
+
+    GLuint texture;
+    GLuint buffer;
+    size_t slot_size;
+    stream_slot_t slots[STREAM_SLOTS];
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    // signalled when a slot is freed or the target moves, and when a frame is ready
+    pthread_cond_t work;
+    pthread_cond_t ready;
+    // frames are numbered from the start of playback, not wrapped to the file
+    int64_t target;
+    int64_t next;
+    int64_t uploaded;
+    // wait for every frame instead of dropping late ones
+    bool blocking;
+    bool stop;
+
+    uint64_t uploads;
+    uint64_t drops;
+    double first_upload;
+    double last_upload;
+} stream_t;
+
+// true for paths stream_open() handles: *.y4m files and image sequence patterns, which have
+// exactly one %d, %<width>d or %0<width>d and no other conversion than %%
+bool stream_is_stream(const char* path);
+// exits if the file can't be read
+stream_t* stream_open(const char* path);
+// creates the texture on unit and starts decoding
+void stream_start(stream_t* stream, int unit);
+// uploads the newest decoded frame for `time` if it isn't on the texture yet, true if it did.
+// never waits for the worker unless blocking is set
+bool stream_update(stream_t* stream, float time, int unit);
+void stream_destroy(stream_t* stream);
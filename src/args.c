@@ -6,12 +6,15 @@
 #include <string.h>
 #include <wlr-layer-shell-unstable-v1-client-protocol.h>
 
+#include "stb_ds.h"
+
 void usage(char* argv[]) {
     printf(
         "%s " PROJECT_VERSION "\n"
         "get an overlay of your choice on your wayland compositor\n"
         "\n"
         "Usage: %s FRAGMENT [OPTIONS]\n"
+        "       %s --daemon [FRAGMENT] [OPTIONS]\n"
         "\n"
         "Arguments:\n"
         "  FRAGMENT                         path to the fragment shader\n"
@@ -33,10 +36,85 @@ void usage(char* argv[]) {
         "                                   default: overlay\n"
         "  -o, --output <output>            set the output of the overlay\n"
         "                                   default: NULL\n"
+        "      --all-outputs                put an overlay on every output\n"
+        "                                   default: false\n"
+        "      --opaque                     treat the overlay as fully opaque, ignoring alpha\n"
+        "                                   default: false\n"
+        "  -d, --damage <x>,<y>,<w>,<h>     only this part of the overlay changes\n"
+        "                                   between frames\n"
+        "                                   default: the whole overlay\n",
+        argv[0],
+        argv[0],
+        argv[0]
+    );
+    // split up, compilers only have to support string literals up to 4095 characters
+    printf(
+        "      --render-scale <factor>      render at a fraction of the output resolution\n"
+        "                                   default: 1.0\n"
+        "      --frame-budget <ms>          lower the resolution to keep the GPU time of a\n"
+        "                                   frame under <ms> milliseconds\n"
+        "                                   default: off\n"
+        "      --interval <ms>              redraw every <ms> milliseconds, on the wall\n"
+        "                                   clock, rather than every frame. for status bars,\n"
+        "                                   at least 1\n"
+        "                                   default: off\n"
+        "      --stats                      print frame and wakeup statistics on exit\n"
+        "                                   default: false\n"
+        "      --headless <w>x<h>           render offscreen without a compositor, for\n"
+        "                                   benchmarks. implies --stats\n"
+        "                                   default: false\n"
+        "      --frames <count>             stop after drawing this many frames\n"
+        "                                   default: unlimited, 600 with --headless\n"
+        "      --duration <seconds>         stop after this long\n"
+        "                                   default: unlimited\n"
+        "      --json <path>                write the --stats results as JSON, - for stdout.\n"
+        "                                   implies --stats\n"
+        "                                   default: NULL\n"
+        "      --export <directory>         render headless at the --width x --height size\n"
+        "                                   with a fixed timestep and write the frames to\n"
+        "                                   <directory>\n"
+        "                                   default: NULL\n"
+    );
+    printf(
+        "      --bake-loop <seconds>        render one period of a looping shader once and\n"
+        "                                   play it back from memory\n"
+        "                                   default: off\n"
+        "      --bake-max-mb <mb>           GPU memory a baked loop may take, larger ones\n"
+        "                                   are baked at a lower resolution\n"
+        "                                   default: 512\n"
+        "      --fps <rate>                 frames per second of exports and baked loops\n"
+        "                                   default: 60\n"
+        "      --format <format>            format of exported frames\n"
+        "                                   (rgba|ppm|pam|y4m)\n"
+        "                                   default: pam\n"
+        "      --watch                      reload the fragment shader when the file changes\n"
+        "                                   default: false\n"
+        "      --render-thread              handle compositor events on a second thread, so\n"
+        "                                   resizes are taken in while a frame is drawn\n"
+        "                                   default: false\n"
+        "      --pass <name>=<path>[,<opt>] render <path> into a texture before each frame,\n"
+        "                                   sampled as u_pass_<name> and u_prev_<name>. opts:\n"
+        "                                   scale=<factor>, format=(rgba8|rgba16f|rgba32f),\n"
+        "                                   filter=(linear|nearest), wrap=(clamp|repeat),\n"
+        "                                   rate=<hz> to step at a fixed rate\n"
+        "                                   default: none, can be repeated\n"
+        "      --channel <n>=<path>         load a PNG or JPEG image as u_channel<n>, with n\n"
+        "                                   from 0 to 7. .y4m files and image sequences\n"
+        "                                   (frame%%04d.png) play as video\n"
+        "                                   default: none, can be repeated\n"
+        "      --feed <name>                read the glshell_feed uniform block from a shared\n"
+        "                                   memory object (/<name>) or fd:<n>\n"
+        "                                   default: NULL\n"
+        "      --daemon                     keep running and take commands on\n"
+        "                                   $XDG_RUNTIME_DIR/glshell.sock to create, change\n"
+        "                                   and remove overlays, FRAGMENT is the first one\n"
+        "                                   default: false\n"
         "\n"
         "Example:\n"
         "  %s example/mandelbrot.frag -l background\n"
-        "  %s example/mandelbrot.frag -h 300 -m 10 -a top:middle -r -l bottom\n",
+        "  %s example/mandelbrot.frag -h 300 -m 10 -a top:middle -r -l bottom\n"
+        "  %s example/mandelbrot.frag --headless 1920x1080 --duration 10\n"
+        "  %s example/mandelbrot.frag -w 1280 -h 720 --export out --format y4m\n",
         argv[0],
         argv[0],
         argv[0],
@@ -44,6 +122,92 @@ void usage(char* argv[]) {
     );
 }
 
+bool args_parse_surface(args_t* args, int argc, char* argv[], int* i) {
+    const char* option = argv[*i];
+    if (strcmp(option, "-r") == 0 || strcmp(option, "--reserve") == 0) {
+        args->reserve = true;
+        return true;
+    } else if (strcmp(option, "--all-outputs") == 0) {
+        args->all_outputs = true;
+        return true;
+    } else if (strcmp(option, "--opaque") == 0) {
+        args->opaque = true;
+        return true;
+    }
+
+    // the rest take a value
+    if (*i + 1 >= argc) {
+        return false;
+    }
+    char* value = argv[*i + 1];
+    if (strcmp(option, "-w") == 0 || strcmp(option, "--width") == 0) {
+        args->width = atoi(value);
+    } else if (strcmp(option, "-h") == 0 || strcmp(option, "--height") == 0) {
+        args->height = atoi(value);
+    } else if (strcmp(option, "-m") == 0 || strcmp(option, "--margin") == 0) {
+        args->margin = atoi(value);
+    } else if (strcmp(option, "-o") == 0 || strcmp(option, "--output") == 0) {
+        args->output_name = value;
+    } else if (strcmp(option, "--render-scale") == 0) {
+        args->render_scale = atof(value);
+        if (args->render_scale <= 0.0f) {
+            return false;
+        }
+    } else if (strcmp(option, "-l") == 0 || strcmp(option, "--layer") == 0) {
+        if (strcmp(value, "background") == 0) {
+            args->layer = ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND;
+        } else if (strcmp(value, "bottom") == 0) {
+            args->layer = ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM;
+        } else if (strcmp(value, "top") == 0) {
+            args->layer = ZWLR_LAYER_SHELL_V1_LAYER_TOP;
+        } else if (strcmp(value, "overlay") == 0) {
+            args->layer = ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY;
+        } else {
+            return false;
+        }
+    } else if (strcmp(option, "-a") == 0 || strcmp(option, "--anchor") == 0) {
+        if (strcmp(value, "top:left") == 0) {
+            args->anchor =
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT;
+        } else if (strcmp(value, "top:middle") == 0) {
+            args->anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+        } else if (strcmp(value, "top:right") == 0) {
+            args->anchor =
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+        } else if (strcmp(value, "middle:left") == 0) {
+            args->anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT;
+        } else if (strcmp(value, "middle:middle") == 0) {
+            args->anchor =
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+        } else if (strcmp(value, "middle:right") == 0) {
+            args->anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+        } else if (strcmp(value, "bottom:left") == 0) {
+            args->anchor =
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT;
+        } else if (strcmp(value, "bottom:middle") == 0) {
+            args->anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                           ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+        } else if (strcmp(value, "bottom:right") == 0) {
+            args->anchor =
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    (*i)++;
+    return true;
+}
+
 args_t args_parse(int argc, char* argv[]) {
     args_t args = {
         .fragment_shader = NULL,
@@ -55,6 +219,26 @@ args_t args_parse(int argc, char* argv[]) {
         .reserve = true,
         .layer = ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
         .output_name = NULL,
+        .opaque = false,
+        .has_damage = false,
+        .frame_budget = 0.0f,
+        .interval = 0.0f,
+        .stats = false,
+        .headless = false,
+        .frames = 0,
+        .duration = 0.0f,
+        .json = NULL,
+        .export_directory = NULL,
+        .fps = 60.0f,
+        .format = "pam",
+        .bake_loop = 0.0f,
+        .bake_max_mb = 512.0f,
+        .watch = false,
+        .render_thread = false,
+        .passes = NULL,
+        .channels = NULL,
+        .feed = NULL,
+        .daemon = false,
     };
 
     if (argc < 2) {
@@ -62,76 +246,122 @@ args_t args_parse(int argc, char* argv[]) {
         exit(1);
     }
 
-    args.fragment_shader = argv[1];
-
-    for (int i = 2; i < argc; i++) {
-        if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--width") == 0) {
-            args.width = atoi(argv[++i]);
-        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--height") == 0) {
-            args.height = atoi(argv[++i]);
-        } else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--margin") == 0) {
-            args.margin = atoi(argv[++i]);
-        } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
-            char* output = argv[++i];
-            args.output_name = output;
-        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--reserve") == 0) {
-            args.reserve = true;
-        } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--layer") == 0) {
-            char* layer = argv[++i];
-            if (strcmp(layer, "background") == 0) {
-                args.layer = ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND;
-            } else if (strcmp(layer, "bottom") == 0) {
-                args.layer = ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM;
-            } else if (strcmp(layer, "top") == 0) {
-                args.layer = ZWLR_LAYER_SHELL_V1_LAYER_TOP;
-            } else if (strcmp(layer, "overlay") == 0) {
-                args.layer = ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY;
-            } else {
+    for (int i = 1; i < argc; i++) {
+        if (args_parse_surface(&args, argc, argv, &i)) {
+            continue;
+        } else if (argv[i][0] != '-' && args.fragment_shader == NULL) {
+            args.fragment_shader = argv[i];
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            args.daemon = true;
+        } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--damage") == 0) {
+            char* damage = argv[++i];
+            if (sscanf(
+                    damage,
+                    "%d,%d,%d,%d",
+                    &args.damage[0],
+                    &args.damage[1],
+                    &args.damage[2],
+                    &args.damage[3]
+                ) != 4) {
+                usage(argv);
+                exit(1);
+            }
+            args.has_damage = true;
+        } else if (strcmp(argv[i], "--frame-budget") == 0) {
+            args.frame_budget = atof(argv[++i]);
+            if (args.frame_budget <= 0.0f) {
                 usage(argv);
                 exit(1);
             }
-        } else if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--anchor") == 0) {
-            char* anchor = argv[++i];
-            if (strcmp(anchor, "top:left") == 0) {
-                args.anchor =
-                    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT;
-            } else if (strcmp(anchor, "top:middle") == 0) {
-                args.anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-            } else if (strcmp(anchor, "top:right") == 0) {
-                args.anchor =
-                    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-            } else if (strcmp(anchor, "middle:left") == 0) {
-                args.anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT;
-            } else if (strcmp(anchor, "middle:middle") == 0) {
-                args.anchor =
-                    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
-                    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-            } else if (strcmp(anchor, "middle:right") == 0) {
-                args.anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-            } else if (strcmp(anchor, "bottom:left") == 0) {
-                args.anchor =
-                    ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT;
-            } else if (strcmp(anchor, "bottom:middle") == 0) {
-                args.anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
-                              ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-            } else if (strcmp(anchor, "bottom:right") == 0) {
-                args.anchor =
-                    ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-            } else {
+        } else if (strcmp(argv[i], "--interval") == 0) {
+            args.interval = atof(argv[++i]);
+            // at least a millisecond, which NaN fails too. faster ticks outpace any output
+            if (!(args.interval >= 1.0f)) {
                 usage(argv);
                 exit(1);
             }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            args.stats = true;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            char* size = argv[++i];
+            if (sscanf(size, "%dx%d", &args.width, &args.height) != 2 || args.width <= 0 ||
+                args.height <= 0) {
+                usage(argv);
+                exit(1);
+            }
+            args.headless = true;
+            args.stats = true;
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            args.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0) {
+            args.duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            args.json = argv[++i];
+            args.stats = true;
+        } else if (strcmp(argv[i], "--export") == 0) {
+            args.export_directory = argv[++i];
+        } else if (strcmp(argv[i], "--bake-loop") == 0) {
+            args.bake_loop = atof(argv[++i]);
+            if (args.bake_loop <= 0.0f) {
+                usage(argv);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--bake-max-mb") == 0) {
+            args.bake_max_mb = atof(argv[++i]);
+            if (args.bake_max_mb <= 0.0f) {
+                usage(argv);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            args.fps = atof(argv[++i]);
+            if (args.fps <= 0.0f) {
+                usage(argv);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            args.format = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            args.watch = true;
+        } else if (strcmp(argv[i], "--render-thread") == 0) {
+            args.render_thread = true;
+        } else if (strcmp(argv[i], "--pass") == 0) {
+            arrput(args.passes, argv[++i]);
+        } else if (strcmp(argv[i], "--channel") == 0) {
+            arrput(args.channels, argv[++i]);
+        } else if (strcmp(argv[i], "--feed") == 0) {
+            args.feed = argv[++i];
         } else {
             usage(argv);
             exit(1);
         }
     }
+
+    // the daemon starts without an overlay unless it is given one
+    if (args.fragment_shader == NULL && !args.daemon) {
+        usage(argv);
+        exit(1);
+    }
+    if (args.daemon && (args.headless || args.export_directory != NULL)) {
+        printf("[glshell] error: --daemon needs a compositor\n");
+        exit(1);
+    }
+
+    // exports run on their own clock, so a duration is a number of frames
+    if (args.export_directory != NULL) {
+        if (args.width <= 0 || args.height <= 0) {
+            printf("[glshell] error: --export needs --width and --height\n");
+            exit(1);
+        }
+        args.headless = true;
+        if (args.duration > 0.0f) {
+            args.frames = args.duration * args.fps + 0.5f;
+            args.duration = 0.0f;
+        }
+    }
+
+    // a benchmark has to end by itself
+    if (args.headless && args.frames <= 0 && args.duration <= 0.0f) {
+        args.frames = 600;
+    }
     return args;
 }
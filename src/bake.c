@@ -0,0 +1,329 @@
+#include "bake.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+
+#define BAKE_MAGIC "GLSHBAK1"
+
+struct bake_header {
+    char magic[8];
+    uint64_t key;
+    int32_t width;
+    int32_t height;
+    int32_t frames;
+};
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static size_t layer_size(bake_t* bake) {
+    return (size_t)bake->width * bake->height * 4;
+}
+
+// frames rendered or written to the cache per frame drawn, and read from it, which is cheaper
+#define BAKE_STEP 2
+#define BAKE_LOAD_STEP 8
+// the smallest fraction of the surface size a bake is shrunk to, to fit max_bytes
+#define BAKE_MIN_SCALE 0.25
+
+// the cache entry, if it is one for this bake, positioned at the first frame
+static FILE* cache_find(bake_t* bake) {
+    FILE* file = cache_open(bake->name);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    struct bake_header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, BAKE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.key == bake->key && header.width == bake->width &&
+              header.height == bake->height && header.frames == bake->frames;
+    if (!ok) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+// a frame missing from the cache is rendered, and so is every one after it
+static void load_frames(bake_t* bake) {
+    uint8_t* pixels = malloc(layer_size(bake));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bake->texture);
+    for (int i = 0; i < BAKE_LOAD_STEP && bake->baked < bake->frames; i++) {
+        if (fread(pixels, layer_size(bake), 1, bake->cache) != 1) {
+            fclose(bake->cache);
+            bake->cache = NULL;
+            break;
+        }
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY,
+            0,
+            0,
+            0,
+            bake->baked,
+            bake->width,
+            bake->height,
+            1,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            pixels
+        );
+        bake->baked++;
+    }
+    free(pixels);
+}
+
+static void render_frames(bake_t* bake, bake_draw_fn draw, void* data) {
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, bake->framebuffer);
+    for (int i = 0; i < BAKE_STEP && bake->baked < bake->frames; i++) {
+        glFramebufferTextureLayer(
+            GL_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            bake->texture,
+            0,
+            bake->baked
+        );
+        draw(data, bake->period * bake->baked / bake->frames, bake->width, bake->height);
+        bake->baked++;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    bake->layer = -1;
+}
+
+static void begin_save(bake_t* bake) {
+    if (!cache_begin_write(bake->name, &bake->writer)) {
+        printf("[glshell] warning: unable to write bake cache\n");
+        return;
+    }
+
+    struct bake_header header = {
+        .key = bake->key,
+        .width = bake->width,
+        .height = bake->height,
+        .frames = bake->frames,
+    };
+    memcpy(header.magic, BAKE_MAGIC, sizeof(header.magic));
+    bake->saving = true;
+    if (fwrite(&header, sizeof(header), 1, bake->writer.file) != 1) {
+        cache_commit(&bake->writer, false);
+        bake->saving = false;
+        printf("[glshell] warning: unable to write bake cache\n");
+    }
+}
+
+// one layer at a time, the whole loop may not fit in memory
+static void save_frames(bake_t* bake) {
+    GLint source;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &source);
+    uint8_t* pixels = malloc(layer_size(bake));
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, bake->framebuffer);
+    bool ok = true;
+    for (int i = 0; ok && i < BAKE_STEP && bake->saved < bake->frames; i++) {
+        glFramebufferTextureLayer(
+            GL_READ_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            bake->texture,
+            0,
+            bake->saved
+        );
+        glReadPixels(0, 0, bake->width, bake->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        ok = fwrite(pixels, layer_size(bake), 1, bake->writer.file) == 1;
+        bake->saved++;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    bake->layer = -1;
+    free(pixels);
+
+    if (!ok || bake->saved == bake->frames) {
+        bake->saving = false;
+        if (!cache_commit(&bake->writer, ok)) {
+            printf("[glshell] warning: unable to write bake cache\n");
+        }
+    }
+}
+
+bool bake_create(
+    bake_t* bake,
+    const char* fragment_shader,
+    float period,
+    int frames,
+    int width,
+    int height,
+    size_t max_bytes
+) {
+    memset(bake, 0, sizeof(*bake));
+    bake->frames = frames;
+    bake->period = period;
+    bake->layer = -1;
+
+    GLint max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    if (frames > max_layers) {
+        printf(
+            "[glshell] warning: %d frames to bake, but the GPU allows %d, not baking\n",
+            frames,
+            max_layers
+        );
+        return false;
+    }
+
+    // drivers that allocate lazily never report GL_OUT_OF_MEMORY, so the size is capped up
+    // front. playback scales the frames up like those of a surface of another size
+    double size = (double)width * height * 4 * frames;
+    if (size > max_bytes) {
+        double scale = sqrt(max_bytes / size);
+        if (scale < BAKE_MIN_SCALE) {
+            printf(
+                "[glshell] warning: %d frames of %dx%d take %.1f MB, over the %.1f MB of "
+                "--bake-max-mb, rendering live\n",
+                frames,
+                width,
+                height,
+                size / (1024 * 1024),
+                max_bytes / (1024.0 * 1024.0)
+            );
+            return false;
+        }
+        printf(
+            "[glshell] baking at %.0f%% of %dx%d to stay within --bake-max-mb\n",
+            scale * 100.0,
+            width,
+            height
+        );
+        width = width * scale > 1.0 ? width * scale : 1;
+        height = height * scale > 1.0 ? height * scale : 1;
+    }
+    bake->width = width;
+    bake->height = height;
+
+    printf(
+        "[glshell] baking %d frames of %dx%d (%.0f MB)\n",
+        frames,
+        width,
+        height,
+        (double)layer_size(bake) * frames / (1024 * 1024)
+    );
+
+    // drain earlier errors, so GL_OUT_OF_MEMORY below is ours
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    glGenTextures(1, &bake->texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bake->texture);
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_RGBA8,
+        width,
+        height,
+        frames,
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        NULL
+    );
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        printf("[glshell] warning: not enough GPU memory to bake, rendering live\n");
+        glDeleteTextures(1, &bake->texture);
+        return false;
+    }
+    glGenFramebuffers(1, &bake->framebuffer);
+
+    uint64_t key = cache_hash_string(CACHE_HASH_INIT, fragment_shader);
+    key = cache_hash(key, &period, sizeof(period));
+    key = cache_hash(key, &frames, sizeof(frames));
+    key = cache_hash(key, &width, sizeof(width));
+    key = cache_hash(key, &height, sizeof(height));
+    // blending changes what ends up in the frames
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    key = cache_hash(key, &blend, sizeof(blend));
+    bake->key = key;
+    snprintf(bake->name, sizeof(bake->name), "%016" PRIx64 ".bake", key);
+
+    bake->cache = cache_find(bake);
+    bake->start = now_ms();
+    return true;
+}
+
+bool bake_step(bake_t* bake, bake_draw_fn draw, void* data) {
+    if (bake->baked == bake->frames) {
+        if (bake->saving) {
+            save_frames(bake);
+        }
+        return true;
+    }
+
+    if (bake->cache != NULL) {
+        load_frames(bake);
+    } else {
+        render_frames(bake, draw, data);
+    }
+    if (bake->baked < bake->frames) {
+        return false;
+    }
+
+    if (bake->cache != NULL) {
+        printf("[glshell] bake loaded from cache in %.2f ms\n", now_ms() - bake->start);
+        fclose(bake->cache);
+        bake->cache = NULL;
+    } else {
+        printf("[glshell] baked in %.2f ms\n", now_ms() - bake->start);
+        begin_save(bake);
+    }
+    return true;
+}
+
+void bake_play(bake_t* bake, float time, int width, int height) {
+    int layer = (int)(fmodf(time, bake->period) / bake->period * bake->frames) % bake->frames;
+
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, bake->framebuffer);
+    if (layer != bake->layer) {
+        glFramebufferTextureLayer(
+            GL_READ_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            bake->texture,
+            0,
+            layer
+        );
+        bake->layer = layer;
+    }
+
+    bool scaled = width != bake->width || height != bake->height;
+    glBlitFramebuffer(
+        0,
+        0,
+        bake->width,
+        bake->height,
+        0,
+        0,
+        width,
+        height,
+        GL_COLOR_BUFFER_BIT,
+        scaled ? GL_LINEAR : GL_NEAREST
+    );
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+}
+
+void bake_destroy(bake_t* bake) {
+    if (bake->cache != NULL) {
+        fclose(bake->cache);
+    }
+    // a bake cut short isn't cached
+    if (bake->saving) {
+        cache_commit(&bake->writer, false);
+    }
+    glDeleteFramebuffers(1, &bake->framebuffer);
+    glDeleteTextures(1, &bake->texture);
+}
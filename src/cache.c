@@ -0,0 +1,138 @@
+#include "cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FNV_PRIME 0x100000001b3ULL
+
+uint64_t cache_hash(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t cache_hash_string(uint64_t hash, const char* string) {
+    // include the terminator so that consecutive strings can't run into each other
+    return cache_hash(hash, string, strlen(string) + 1);
+}
+
+static bool make_dir(const char* path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+char* cache_path(const char* name) {
+    const char* xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char dir[4096];
+
+    if (xdg_cache_home != NULL && xdg_cache_home[0] != '\0') {
+        snprintf(dir, sizeof(dir), "%s", xdg_cache_home);
+    } else if (home != NULL) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    } else {
+        return NULL;
+    }
+
+    if (!make_dir(dir)) {
+        return NULL;
+    }
+    strncat(dir, "/" PROJECT_NAME, sizeof(dir) - strlen(dir) - 1);
+    if (!make_dir(dir)) {
+        return NULL;
+    }
+
+    size_t length = strlen(dir) + strlen(name) + 2;
+    char* path = malloc(length);
+    snprintf(path, length, "%s/%s", dir, name);
+    return path;
+}
+
+void* cache_read(const char* name, size_t* size) {
+    char* path = cache_path(name);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    FILE* file = fopen(path, "rb");
+    free(path);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (file_size <= 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    void* data = malloc(file_size);
+    if (fread(data, 1, file_size, file) != (size_t)file_size) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    *size = file_size;
+    return data;
+}
+
+bool cache_write(const char* name, const void* data, size_t size) {
+    cache_writer_t writer;
+    if (!cache_begin_write(name, &writer)) {
+        return false;
+    }
+    return cache_commit(&writer, fwrite(data, 1, size, writer.file) == size);
+}
+
+FILE* cache_open(const char* name) {
+    char* path = cache_path(name);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    FILE* file = fopen(path, "rb");
+    free(path);
+    return file;
+}
+
+bool cache_begin_write(const char* name, cache_writer_t* writer) {
+    writer->path = cache_path(name);
+    if (writer->path == NULL) {
+        return false;
+    }
+
+    // write to a temporary file first so that a concurrent reader never sees half an entry
+    size_t tmp_length = strlen(writer->path) + 32;
+    writer->tmp_path = malloc(tmp_length);
+    snprintf(writer->tmp_path, tmp_length, "%s.%d.tmp", writer->path, (int)getpid());
+
+    writer->file = fopen(writer->tmp_path, "wb");
+    if (writer->file == NULL) {
+        free(writer->tmp_path);
+        free(writer->path);
+        return false;
+    }
+    return true;
+}
+
+bool cache_commit(cache_writer_t* writer, bool ok) {
+    ok = fclose(writer->file) == 0 && ok;
+    ok = ok && rename(writer->tmp_path, writer->path) == 0;
+    if (!ok) {
+        unlink(writer->tmp_path);
+    }
+
+    free(writer->tmp_path);
+    free(writer->path);
+    return ok;
+}
@@ -0,0 +1,358 @@
+#include "channel.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "glshell.h"
+#include "image.h"
+#include "stb_ds.h"
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+typedef struct decode_job {
+    channels_t* channels;
+    channel_t* channel;
+} decode_job_t;
+
+static void* decode_worker(void* data) {
+    decode_job_t* job = data;
+    channel_t* channel = job->channel;
+    double start = now_ms();
+
+    int width = 0;
+    int height = 0;
+    const char* error = NULL;
+    unsigned char* pixels = image_load(channel->path, &width, &height, &error);
+
+    pthread_mutex_lock(&job->channels->mutex);
+    channel->pixels = pixels;
+    channel->width = width;
+    channel->height = height;
+    channel->error = error;
+    channel->decode_ms = now_ms() - start;
+    channel->decoded = true;
+    pthread_cond_broadcast(&job->channels->decoded);
+    pthread_mutex_unlock(&job->channels->mutex);
+
+    uint64_t one = 1;
+    write(job->channels->event, &one, sizeof(one));
+    free(job);
+    return NULL;
+}
+
+channels_t* channels_load(char** specs) {
+    channels_t* channels = calloc(1, sizeof(channels_t));
+    pthread_mutex_init(&channels->mutex, NULL);
+    pthread_cond_init(&channels->decoded, NULL);
+    channels->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    for (int i = 0; i < arrlen(specs); i++) {
+        char* path;
+        long index = strtol(specs[i], &path, 10);
+        if (path == specs[i] || *path != '=' || index < 0 || index >= CHANNEL_COUNT) {
+            printf(
+                "[glshell] error: channel %s is not <n>=<path> with n below %d\n",
+                specs[i],
+                CHANNEL_COUNT
+            );
+            exit(1);
+        }
+
+        channel_t* channel = &channels->channels[index];
+        if (channel->path != NULL) {
+            printf("[glshell] error: channel %ld is given twice\n", index);
+            exit(1);
+        }
+        channel->path = strdup(path + 1);
+        if (stream_is_stream(channel->path)) {
+            channel->stream = stream_open(channel->path);
+            continue;
+        }
+        // a missing or unsupported file is reported now rather than from the first frames
+        int width, height;
+        if (!image_info(channel->path, &width, &height)) {
+            printf("[glshell] error: %s is not a readable PNG or JPEG image\n", channel->path);
+            exit(1);
+        }
+
+        decode_job_t* job = malloc(sizeof(decode_job_t));
+        job->channels = channels;
+        job->channel = channel;
+        pthread_create(&channel->thread, NULL, decode_worker, job);
+    }
+
+    return channels;
+}
+
+// a black pixel for an image that passed the header check in channels_load() but didn't
+// decode, so that the channel isn't uploaded again and its thread isn't joined twice
+static void upload_black(channel_t* channel, int index) {
+    static const unsigned char black[4] = { 0, 0, 0, 255 };
+    glActiveTexture(GL_TEXTURE0 + CHANNEL_UNIT(index));
+    glGenTextures(1, &channel->texture);
+    glBindTexture(GL_TEXTURE_2D, channel->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// copies the pixels through a pixel buffer object, so the driver can transfer them while the
+// frame is drawn, and lets the GPU build the mipmap chain
+static void upload(channel_t* channel, int index) {
+    // called between frames, a corrupt file must not take the overlay down
+    if (channel->pixels == NULL) {
+        printf(
+            "[glshell] warning: unable to load %s: %s, channel %d stays black\n",
+            channel->path,
+            channel->error,
+            index
+        );
+        upload_black(channel, index);
+        return;
+    }
+
+    size_t size = (size_t)channel->width * channel->height * 4;
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    void* data = glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER,
+        0,
+        size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+    );
+    memcpy(data, channel->pixels, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    image_free(channel->pixels);
+    channel->pixels = NULL;
+
+    glActiveTexture(GL_TEXTURE0 + CHANNEL_UNIT(index));
+    glGenTextures(1, &channel->texture);
+    glBindTexture(GL_TEXTURE_2D, channel->texture);
+    glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA8,
+        channel->width,
+        channel->height,
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        0
+    );
+    // trilinear filtering picks the levels matching the size the image is drawn at
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glActiveTexture(GL_TEXTURE0);
+
+    // the buffer is only freed once the transfer is done
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    printf(
+        "[glshell] channel %d: %s, %dx%d, decoded in %.2f ms\n",
+        index,
+        channel->path,
+        channel->width,
+        channel->height,
+        channel->decode_ms
+    );
+}
+
+// uploads every decoded image that isn't yet, true if there was one
+static bool upload_decoded(channels_t* channels) {
+    bool uploaded = false;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        channel_t* channel = &channels->channels[i];
+        if (channel->path == NULL || channel->texture != 0 || channel->stream != NULL) {
+            continue;
+        }
+
+        pthread_mutex_lock(&channels->mutex);
+        bool decoded = channel->decoded;
+        pthread_mutex_unlock(&channels->mutex);
+        if (decoded) {
+            pthread_join(channel->thread, NULL);
+            upload(channel, i);
+            channels->changed |= 1u << i;
+            uploaded = true;
+        }
+    }
+    return uploaded;
+}
+
+static void channels_decoded(void* data) {
+    channels_t* channels = data;
+    uint64_t count;
+    read(channels->event, &count, sizeof(count));
+
+    // static shaders have to be drawn again to show the image, draw_shader() passes the
+    // channels on to the render graph passes sampling them
+    if (upload_decoded(channels)) {
+        glshell_redraw(channels->glshell);
+    }
+}
+
+void channels_init_gl(channels_t* channels, glshell_t* glshell) {
+    channels->glshell = glshell;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        if (channels->channels[i].stream != NULL) {
+            stream_start(channels->channels[i].stream, CHANNEL_UNIT(i));
+        }
+    }
+    upload_decoded(channels);
+    glshell_watch_fd(glshell, channels->event, channels_decoded, channels);
+}
+
+void channels_wait(channels_t* channels) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        channel_t* channel = &channels->channels[i];
+        if (channel->stream != NULL) {
+            channel->stream->blocking = true;
+        }
+        if (channel->path == NULL || channel->stream != NULL) {
+            continue;
+        }
+        pthread_mutex_lock(&channels->mutex);
+        while (!channel->decoded) {
+            pthread_cond_wait(&channels->decoded, &channels->mutex);
+        }
+        pthread_mutex_unlock(&channels->mutex);
+    }
+    upload_decoded(channels);
+}
+
+void channels_update(channels_t* channels, float time) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        stream_t* stream = channels->channels[i].stream;
+        if (stream != NULL && stream_update(stream, time, CHANNEL_UNIT(i))) {
+            channels->changed |= 1u << i;
+        }
+    }
+}
+
+bool channels_animated(channels_t* channels) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        if (channels->channels[i].stream != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// megabytes per second from the first upload to the last
+static float upload_rate(stream_t* stream) {
+    double seconds = (stream->last_upload - stream->first_upload) / 1000.0;
+    if (stream->uploads < 2 || seconds <= 0.0) {
+        return 0.0f;
+    }
+    return (stream->uploads - 1) * stream->slot_size / seconds / 1000000.0;
+}
+
+void channels_print_stats(channels_t* channels) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        stream_t* stream = channels->channels[i].stream;
+        if (stream == NULL) {
+            continue;
+        }
+        printf(
+            "[glshell] stats: channel %d: %" PRIu64 " frames uploaded at %.1f MB/s, %" PRIu64
+            " dropped\n",
+            i,
+            stream->uploads,
+            upload_rate(stream),
+            stream->drops
+        );
+    }
+}
+
+void channels_write_json(channels_t* channels, FILE* file) {
+    fprintf(file, "\"streams\": [");
+    bool first = true;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        stream_t* stream = channels->channels[i].stream;
+        if (stream == NULL) {
+            continue;
+        }
+        fprintf(
+            file,
+            "%s{\"channel\": %d, \"uploaded_frames\": %" PRIu64 ", \"dropped_frames\": %" PRIu64
+            ", \"upload_mb_s\": %.4f}",
+            first ? "" : ", ",
+            i,
+            stream->uploads,
+            stream->drops,
+            upload_rate(stream)
+        );
+        first = false;
+    }
+    fprintf(file, "]");
+}
+
+uint32_t channels_take_changed(channels_t* channels) {
+    uint32_t changed = channels->changed;
+    channels->changed = 0;
+    return changed;
+}
+
+uint32_t channels_link(channels_t* channels, GLuint program) {
+    glUseProgram(program);
+    uint32_t sampled = 0;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "u_channel%d", i);
+        GLint location = glGetUniformLocation(program, name);
+        if (location == -1) {
+            continue;
+        }
+        if (channels->channels[i].path == NULL) {
+            printf("[glshell] warning: %s is sampled, but no image is given for it\n", name);
+        }
+        glUniform1i(location, CHANNEL_UNIT(i));
+        sampled |= 1u << i;
+    }
+    return sampled;
+}
+
+void channels_destroy(channels_t* channels) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        channel_t* channel = &channels->channels[i];
+        if (channel->path == NULL) {
+            continue;
+        }
+        if (channel->stream != NULL) {
+            stream_destroy(channel->stream);
+            free(channel->path);
+            continue;
+        }
+        // still decoding if the first frame never came
+        if (channel->texture == 0) {
+            pthread_join(channel->thread, NULL);
+            image_free(channel->pixels);
+        }
+        glDeleteTextures(1, &channel->texture);
+        free(channel->path);
+    }
+    pthread_mutex_destroy(&channels->mutex);
+    pthread_cond_destroy(&channels->decoded);
+    if (channels->glshell != NULL) {
+        glshell_unwatch_fd(channels->glshell, channels->event);
+    }
+    close(channels->event);
+    free(channels);
+}
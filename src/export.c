@@ -0,0 +1,394 @@
+#include "export.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stb_ds.h"
+
+#define Y4M_FRAME_HEADER "FRAME\n"
+
+bool export_parse_format(const char* name, export_format_t* format) {
+    if (strcmp(name, "rgba") == 0) {
+        *format = EXPORT_FORMAT_RGBA;
+    } else if (strcmp(name, "ppm") == 0) {
+        *format = EXPORT_FORMAT_PPM;
+    } else if (strcmp(name, "pam") == 0) {
+        *format = EXPORT_FORMAT_PAM;
+    } else if (strcmp(name, "y4m") == 0) {
+        *format = EXPORT_FORMAT_Y4M;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static const char* format_extension(export_format_t format) {
+    switch (format) {
+        case EXPORT_FORMAT_RGBA:
+            return "rgba";
+        case EXPORT_FORMAT_PPM:
+            return "ppm";
+        case EXPORT_FORMAT_PAM:
+            return "pam";
+        case EXPORT_FORMAT_Y4M:
+            return "y4m";
+    }
+    return "";
+}
+
+static size_t rgba_size(exporter_t* exporter) {
+    return (size_t)exporter->width * exporter->height * 4;
+}
+
+static bool write_all(int file, const uint8_t* data, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written =
+            offset >= 0 ? pwrite(file, data, size, offset) : write(file, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+        if (offset >= 0) {
+            offset += written;
+        }
+    }
+    return true;
+}
+
+// full range BT.601, as y4m's C420jpeg expects
+static uint8_t clamp_byte(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static uint8_t rgb_to_y(int r, int g, int b) {
+    return clamp_byte((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+static uint8_t rgb_to_cb(int r, int g, int b) {
+    return clamp_byte((-43 * r - 85 * g + 128 * b + 32896) >> 8);
+}
+
+static uint8_t rgb_to_cr(int r, int g, int b) {
+    return clamp_byte((128 * r - 107 * g - 21 * b + 32896) >> 8);
+}
+
+// the frame as it goes to disk, top down, into `out`. returns the size
+static size_t convert_frame(exporter_t* exporter, const uint8_t* pixels, uint8_t* out) {
+    int width = exporter->width;
+    int height = exporter->height;
+    size_t stride = (size_t)width * 4;
+    size_t size = 0;
+
+    switch (exporter->format) {
+        case EXPORT_FORMAT_PAM:
+            size = sprintf(
+                (char*)out,
+                "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+                width,
+                height
+            );
+            // fallthrough
+        case EXPORT_FORMAT_RGBA:
+            for (int y = 0; y < height; y++) {
+                memcpy(out + size, pixels + (height - 1 - y) * stride, stride);
+                size += stride;
+            }
+            break;
+        case EXPORT_FORMAT_PPM:
+            size = sprintf((char*)out, "P6\n%d %d\n255\n", width, height);
+            for (int y = 0; y < height; y++) {
+                const uint8_t* row = pixels + (height - 1 - y) * stride;
+                for (int x = 0; x < width; x++) {
+                    out[size++] = row[x * 4 + 0];
+                    out[size++] = row[x * 4 + 1];
+                    out[size++] = row[x * 4 + 2];
+                }
+            }
+            break;
+        case EXPORT_FORMAT_Y4M: {
+            memcpy(out, Y4M_FRAME_HEADER, strlen(Y4M_FRAME_HEADER));
+            uint8_t* luma = out + strlen(Y4M_FRAME_HEADER);
+            for (int y = 0; y < height; y++) {
+                const uint8_t* row = pixels + (height - 1 - y) * stride;
+                for (int x = 0; x < width; x++) {
+                    luma[y * width + x] = rgb_to_y(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]);
+                }
+            }
+
+            // chroma is subsampled 2x2, averaging the pixels each sample covers
+            int chroma_width = (width + 1) / 2;
+            int chroma_height = (height + 1) / 2;
+            uint8_t* cb = luma + (size_t)width * height;
+            uint8_t* cr = cb + (size_t)chroma_width * chroma_height;
+            for (int cy = 0; cy < chroma_height; cy++) {
+                for (int cx = 0; cx < chroma_width; cx++) {
+                    int r = 0, g = 0, b = 0, count = 0;
+                    for (int y = cy * 2; y < cy * 2 + 2 && y < height; y++) {
+                        const uint8_t* row = pixels + (height - 1 - y) * stride;
+                        for (int x = cx * 2; x < cx * 2 + 2 && x < width; x++) {
+                            r += row[x * 4 + 0];
+                            g += row[x * 4 + 1];
+                            b += row[x * 4 + 2];
+                            count++;
+                        }
+                    }
+                    r /= count;
+                    g /= count;
+                    b /= count;
+                    cb[cy * chroma_width + cx] = rgb_to_cb(r, g, b);
+                    cr[cy * chroma_width + cx] = rgb_to_cr(r, g, b);
+                }
+            }
+            size = exporter->frame_size;
+            break;
+        }
+    }
+    return size;
+}
+
+static bool write_frame(exporter_t* exporter, int frame, const uint8_t* data, size_t size) {
+    if (exporter->format == EXPORT_FORMAT_Y4M) {
+        off_t offset = exporter->header_size + (off_t)frame * exporter->frame_size;
+        return write_all(exporter->file, data, size, offset);
+    }
+
+    char path[4096];
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/frame_%06d.%s",
+        exporter->directory,
+        frame,
+        format_extension(exporter->format)
+    );
+    int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file == -1) {
+        return false;
+    }
+    bool written = write_all(file, data, size, -1);
+    return close(file) == 0 && written;
+}
+
+static void* export_worker(void* data) {
+    exporter_t* exporter = data;
+
+    // the largest converted frame is RGBA plus a header
+    uint8_t* out = malloc(rgba_size(exporter) + 256);
+
+    for (;;) {
+        pthread_mutex_lock(&exporter->mutex);
+        while (exporter->job_count == 0 && !exporter->done) {
+            pthread_cond_wait(&exporter->job_ready, &exporter->mutex);
+        }
+        if (exporter->job_count == 0) {
+            pthread_mutex_unlock(&exporter->mutex);
+            break;
+        }
+        struct export_job job = exporter->jobs[exporter->job_first];
+        exporter->job_first = (exporter->job_first + 1) % exporter->job_capacity;
+        exporter->job_count--;
+        pthread_cond_signal(&exporter->job_taken);
+        pthread_mutex_unlock(&exporter->mutex);
+
+        size_t size = convert_frame(exporter, job.pixels, out);
+        bool written = write_frame(exporter, job.frame, out, size);
+        int error = errno;
+
+        pthread_mutex_lock(&exporter->mutex);
+        if (!written && !exporter->failed) {
+            printf(
+                "[glshell] error: unable to write frame %d: %s\n",
+                job.frame,
+                strerror(error)
+            );
+            exporter->failed = true;
+        }
+        arrput(exporter->free_buffers, job.pixels);
+        pthread_mutex_unlock(&exporter->mutex);
+    }
+
+    free(out);
+    return NULL;
+}
+
+exporter_t* exporter_create(
+    const char* directory,
+    export_format_t format,
+    int width,
+    int height,
+    float fps
+) {
+    if (mkdir(directory, 0755) == -1 && errno != EEXIST) {
+        printf("[glshell] error: unable to create %s: %s\n", directory, strerror(errno));
+        exit(1);
+    }
+
+    exporter_t* exporter = calloc(1, sizeof(exporter_t));
+    exporter->directory = strdup(directory);
+    exporter->format = format;
+    exporter->width = width;
+    exporter->height = height;
+    exporter->fps = fps;
+    exporter->file = -1;
+
+    if (format == EXPORT_FORMAT_Y4M) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/frames.y4m", directory);
+        exporter->file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (exporter->file == -1) {
+            printf("[glshell] error: unable to create %s: %s\n", path, strerror(errno));
+            exit(1);
+        }
+
+        // fractional rates as thousandths, e.g. 29.97 becomes 29970:1000
+        char header[128];
+        int rate = fps * 1000.0f + 0.5f;
+        exporter->header_size = snprintf(
+            header,
+            sizeof(header),
+            "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n",
+            width,
+            height,
+            rate
+        );
+        write_all(exporter->file, (uint8_t*)header, exporter->header_size, 0);
+
+        size_t chroma_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+        exporter->frame_size =
+            strlen(Y4M_FRAME_HEADER) + (size_t)width * height + 2 * chroma_size;
+    }
+
+    glGenBuffers(EXPORT_PBOS, exporter->pbos);
+    for (int i = 0; i < EXPORT_PBOS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, exporter->pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, rgba_size(exporter), NULL, GL_STREAM_READ);
+        exporter->pbo_frames[i] = -1;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    exporter->thread_count = cores > 0 ? cores : 1;
+    exporter->job_capacity = exporter->thread_count * EXPORT_QUEUE_PER_THREAD;
+    exporter->jobs = calloc(exporter->job_capacity, sizeof(struct export_job));
+    pthread_mutex_init(&exporter->mutex, NULL);
+    pthread_cond_init(&exporter->job_ready, NULL);
+    pthread_cond_init(&exporter->job_taken, NULL);
+    exporter->threads = calloc(exporter->thread_count, sizeof(pthread_t));
+    for (int i = 0; i < exporter->thread_count; i++) {
+        pthread_create(&exporter->threads[i], NULL, export_worker, exporter);
+    }
+
+    printf(
+        "[glshell] exporting %dx%d %s frames at %.2f fps to %s with %d threads\n",
+        width,
+        height,
+        format_extension(format),
+        fps,
+        directory,
+        exporter->thread_count
+    );
+    return exporter;
+}
+
+// copies a finished readback out of its pixel buffer and queues it for the workers
+static void exporter_retire(exporter_t* exporter, int slot) {
+    glClientWaitSync(exporter->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(exporter->fences[slot]);
+    exporter->fences[slot] = NULL;
+
+    pthread_mutex_lock(&exporter->mutex);
+    uint8_t* pixels = NULL;
+    if (arrlenu(exporter->free_buffers) > 0) {
+        pixels = arrpop(exporter->free_buffers);
+    }
+    pthread_mutex_unlock(&exporter->mutex);
+    if (pixels == NULL) {
+        pixels = malloc(rgba_size(exporter));
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, exporter->pbos[slot]);
+    void* mapped =
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rgba_size(exporter), GL_MAP_READ_BIT);
+    memcpy(pixels, mapped, rgba_size(exporter));
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // waiting here keeps at most a few frames in memory when the disk can't keep up
+    pthread_mutex_lock(&exporter->mutex);
+    while (exporter->job_count == exporter->job_capacity) {
+        pthread_cond_wait(&exporter->job_taken, &exporter->mutex);
+    }
+    int index = (exporter->job_first + exporter->job_count) % exporter->job_capacity;
+    exporter->jobs[index] = (struct export_job){ exporter->pbo_frames[slot], pixels };
+    exporter->job_count++;
+    pthread_cond_signal(&exporter->job_ready);
+    pthread_mutex_unlock(&exporter->mutex);
+
+    exporter->pbo_frames[slot] = -1;
+}
+
+void exporter_capture(exporter_t* exporter, int frame) {
+    int slot = exporter->pbo_next;
+    if (exporter->pbo_frames[slot] != -1) {
+        exporter_retire(exporter, slot);
+    }
+
+    // into the pixel buffer, so this returns without waiting for the frame to finish
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, exporter->pbos[slot]);
+    glReadPixels(0, 0, exporter->width, exporter->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    exporter->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    exporter->pbo_frames[slot] = frame;
+    exporter->pbo_next = (slot + 1) % EXPORT_PBOS;
+    exporter->frames++;
+}
+
+bool exporter_finish(exporter_t* exporter) {
+    // oldest first, the slot after the last one used
+    for (int i = 0; i < EXPORT_PBOS; i++) {
+        int slot = (exporter->pbo_next + i) % EXPORT_PBOS;
+        if (exporter->pbo_frames[slot] != -1) {
+            exporter_retire(exporter, slot);
+        }
+    }
+
+    pthread_mutex_lock(&exporter->mutex);
+    exporter->done = true;
+    pthread_cond_broadcast(&exporter->job_ready);
+    pthread_mutex_unlock(&exporter->mutex);
+    for (int i = 0; i < exporter->thread_count; i++) {
+        pthread_join(exporter->threads[i], NULL);
+    }
+
+    bool failed = exporter->failed;
+    if (exporter->file != -1 && close(exporter->file) != 0) {
+        failed = true;
+    }
+    if (!failed) {
+        printf("[glshell] exported %d frames to %s\n", exporter->frames, exporter->directory);
+    }
+
+    glDeleteBuffers(EXPORT_PBOS, exporter->pbos);
+    for (size_t i = 0; i < arrlenu(exporter->free_buffers); i++) {
+        free(exporter->free_buffers[i]);
+    }
+    arrfree(exporter->free_buffers);
+    pthread_mutex_destroy(&exporter->mutex);
+    pthread_cond_destroy(&exporter->job_ready);
+    pthread_cond_destroy(&exporter->job_taken);
+    free(exporter->threads);
+    free(exporter->jobs);
+    free(exporter->directory);
+    free(exporter);
+
+    return !failed;
+}
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include "feed.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+#include "stb_ds.h"
+
+// tries before giving up on a frame, if a writer keeps changing the values
+#define FEED_READ_TRIES 4
+
+static void futex_wake(feed_t* feed) {
+    syscall(SYS_futex, &feed->shared->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// sleeps until glshell_feed_end() wakes the sequence number, so nothing runs while no writer
+// publishes
+static void* wait_for_writers(void* data) {
+    feed_t* feed = data;
+    uint32_t sequence = atomic_load(&feed->shared->sequence);
+    while (!atomic_load(&feed->stop)) {
+        syscall(SYS_futex, &feed->shared->sequence, FUTEX_WAIT, sequence, NULL, NULL, 0);
+        uint32_t now = atomic_load(&feed->shared->sequence);
+        // an odd number is an update still in progress, its end wakes again
+        if (now != sequence && now % 2 == 0) {
+            uint64_t one = 1;
+            if (write(feed->wakeup, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+                printf(
+                    "[glshell] warning: unable to signal a feed update: %s\n",
+                    strerror(errno)
+                );
+            }
+        }
+        sequence = now;
+    }
+    return NULL;
+}
+
+feed_t* feed_open(const char* name, bool wake) {
+    feed_t* feed = calloc(1, sizeof(feed_t));
+    if (strncmp(name, "fd:", 3) == 0) {
+        feed->shared = glshell_feed_map_readonly(atoi(name + 3));
+    } else {
+        feed->shared = glshell_feed_open_readonly(name);
+    }
+    if (feed->shared == NULL) {
+        printf(
+            "[glshell] error: unable to map feed %s, it has to be created by a writer using "
+            "version %d of glshell_feed.h\n",
+            name,
+            GLSHELL_FEED_VERSION
+        );
+        exit(1);
+    }
+
+    feed->wakeup = -1;
+    if (wake) {
+        feed->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (feed->wakeup == -1 ||
+            pthread_create(&feed->waiter, NULL, wait_for_writers, feed) != 0) {
+            printf("[glshell] error: unable to wait for feed %s: %s\n", name, strerror(errno));
+            exit(1);
+        }
+    }
+
+    glGenBuffers(1, &feed->buffer);
+    feed->stale = true;
+    printf("[glshell] reading values from feed %s\n", name);
+    return feed;
+}
+
+void feed_reset(feed_t* feed) {
+    arrsetlen(feed->members, 0);
+    feed->stale = true;
+}
+
+bool feed_link(feed_t* feed, GLuint program) {
+    GLuint index = glGetUniformBlockIndex(program, "glshell_feed");
+    if (index == GL_INVALID_INDEX) {
+        return false;
+    }
+    glUniformBlockBinding(program, index, FEED_BINDING);
+
+    GLint size;
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+    if (size > arrlen(feed->block)) {
+        arrsetlen(feed->block, size);
+        glBindBuffer(GL_UNIFORM_BUFFER, feed->buffer);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FEED_BINDING, feed->buffer);
+    }
+
+    GLint count;
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+    GLint* indices = malloc(count * sizeof(GLint));
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices);
+
+    // every program declares the same block, the first one to name a member places it
+    for (GLint i = 0; i < count; i++) {
+        GLuint uniform = indices[i];
+        char name[64];
+        GLint array_size;
+        GLenum type;
+        glGetActiveUniform(program, uniform, sizeof(name), NULL, &array_size, &type, name);
+        GLint offset;
+        glGetActiveUniformsiv(program, 1, &uniform, GL_UNIFORM_OFFSET, &offset);
+
+        // members of a block with an instance name are reported as instance.member
+        char* member_name = strrchr(name, '.') != NULL ? strrchr(name, '.') + 1 : name;
+        feed_member_t member = {.offset = offset};
+        switch (type) {
+            case GL_FLOAT:
+                member.components = 1;
+                break;
+            case GL_FLOAT_VEC2:
+                member.components = 2;
+                break;
+            case GL_FLOAT_VEC3:
+                member.components = 3;
+                break;
+            case GL_FLOAT_VEC4:
+                member.components = 4;
+                break;
+            default:
+                printf("[glshell] warning: glshell_feed.%s is not a float or vector\n", name);
+                continue;
+        }
+        snprintf(member.name, sizeof(member.name), "%s", member_name);
+
+        bool known = false;
+        for (int j = 0; j < arrlen(feed->members) && !known; j++) {
+            known = strcmp(feed->members[j].name, member.name) == 0;
+        }
+        if (!known) {
+            arrput(feed->members, member);
+        }
+    }
+    free(indices);
+
+    feed->stale = true;
+    return true;
+}
+
+bool feed_changed(feed_t* feed) {
+    if (arrlen(feed->members) == 0) {
+        return false;
+    }
+    uint32_t sequence = atomic_load_explicit(&feed->shared->sequence, memory_order_relaxed);
+    return sequence != feed->sequence || feed->stale;
+}
+
+bool feed_update(feed_t* feed) {
+    if (arrlen(feed->members) == 0) {
+        return false;
+    }
+
+    const glshell_feed_t* shared = feed->shared;
+    uint32_t sequence = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+    if (sequence == feed->sequence && !feed->stale) {
+        return false;
+    }
+
+    // seqlock read: copy, then check no writer started in the meantime
+    glshell_feed_value_t* values = feed->values;
+    uint32_t count = 0;
+    bool consistent = false;
+    for (int try = 0; try < FEED_READ_TRIES && !consistent; try++) {
+        if (sequence % 2 == 1) {
+            sequence = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+            continue;
+        }
+        bool valid = shared->magic == GLSHELL_FEED_MAGIC &&
+                     shared->version == GLSHELL_FEED_VERSION;
+        count = valid ? shared->count : 0;
+        count = count < GLSHELL_FEED_VALUES ? count : GLSHELL_FEED_VALUES;
+        memcpy(values, shared->values, count * sizeof(glshell_feed_value_t));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t after = atomic_load_explicit(&shared->sequence, memory_order_relaxed);
+        consistent = after == sequence;
+        sequence = after;
+    }
+    if (!consistent) {
+        return false;
+    }
+
+    memset(feed->block, 0, arrlen(feed->block));
+    for (int i = 0; i < arrlen(feed->members); i++) {
+        feed_member_t* member = &feed->members[i];
+        for (uint32_t j = 0; j < count; j++) {
+            if (strncmp(values[j].name, member->name, GLSHELL_FEED_NAME_LENGTH) == 0) {
+                memcpy(
+                    feed->block + member->offset,
+                    values[j].value,
+                    member->components * sizeof(float)
+                );
+                break;
+            }
+        }
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, feed->buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, arrlen(feed->block), feed->block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    feed->sequence = sequence;
+    feed->stale = false;
+    return true;
+}
+
+void feed_destroy(feed_t* feed) {
+    if (feed->wakeup != -1) {
+        // the waiter may have read stop just before it was set and not be asleep yet, so it is
+        // woken until it is gone
+        atomic_store(&feed->stop, true);
+        int joined;
+        do {
+            futex_wake(feed);
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 10000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            joined = pthread_timedjoin_np(feed->waiter, NULL, &deadline);
+        } while (joined == ETIMEDOUT);
+        close(feed->wakeup);
+    }
+    glDeleteBuffers(1, &feed->buffer);
+    glshell_feed_close(feed->shared);
+    arrfree(feed->members);
+    arrfree(feed->block);
+    free(feed);
+}
@@ -1,61 +1,328 @@
 #include "glshell.h"
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
 #include <wayland-client.h>
 #include <wayland-client-protocol.h>
 #include <wayland-egl.h>
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <wayland-util.h>
 
+#include <GL/glew.h>
+
+#include "mailbox.h"
 #include "stb_ds.h"
 
+// how many past frames of damage to remember for buffer age based repaints
+#define GLSHELL_DAMAGE_HISTORY 4
+// frames the GPU may lag behind in headless mode, as with a double buffered swapchain
+#define GLSHELL_HEADLESS_FRAMES 2
+// file descriptors besides the display's that glshell_get_fd() waits on
+#define GLSHELL_MAX_WATCHES 8
+// events the protocol thread records before the render thread replays them, more wait in the
+// overflow list
+#define GLSHELL_MAILBOX_SIZE 256
+
 struct glshell_output_descriptor {
     char* name;
     uint32_t width;
     uint32_t height;
+    int32_t scale;
+    struct wl_output* wl_output;
+    // the registry name, to recognize the output when it goes away
+    uint32_t global_name;
+};
+
+struct glshell_state;
+
+/* One layer surface, all of them share the EGL context */
+struct glshell_surface {
+    struct glshell_state* state;
+    // events recorded by the protocol thread name the surface by id, it may be gone by the time
+    // they are replayed
+    uint32_t id;
+    // the output the size is derived from, only passed to the compositor if bound
+    struct wl_output* wl_output;
+    bool bound;
+
+    /* Objects */
+    struct wl_surface* wl_surface;
+    struct wl_egl_window* wl_egl_surface;
+    struct zwlr_layer_surface_v1* zwlr_layer_surface_v1;
+    struct wl_callback* frame_callback;
+    // wl_surface, or with a render thread a wrapper of it that puts frame callbacks on the
+    // render thread's queue
+    struct wl_surface* frame_surface;
+    struct wp_viewport* wp_viewport;
+    struct wp_fractional_scale_v1* wp_fractional_scale_v1;
+    EGLSurface egl_surface;
+
+    // what we asked the compositor for, 0 to stretch between the anchors
+    uint32_t requested_width;
+    uint32_t requested_height;
+    // the size in surface coordinates, as configured by the compositor
+    uint32_t logical_width;
+    uint32_t logical_height;
+    // preferred scale in 120ths, as in wp_fractional_scale_v1
+    uint32_t scale120;
+    // the buffer size in pixels, what gets rendered
+    uint32_t width;
+    uint32_t height;
+
+    // frame scheduling
+    bool configured;
+    bool frame_ready;
+    // when the oldest configure not yet answered with a frame arrived, zero if there is none
+    struct timespec configure_time;
+
+    // damage, in surface coordinates. an empty rect means the whole surface
+    glshell_rect_t damage;
+    bool full_damage;
+    glshell_rect_t damage_history[GLSHELL_DAMAGE_HISTORY];
+    int damage_history_length;
+};
+
+struct glshell_watch {
+    int fd;
+    glshell_fd_callback_t callback;
+    void* data;
+};
+
+enum glshell_message_type {
+    GLSHELL_MESSAGE_GLOBAL,
+    GLSHELL_MESSAGE_GLOBAL_REMOVE,
+    GLSHELL_MESSAGE_OUTPUT_NAME,
+    GLSHELL_MESSAGE_OUTPUT_DONE,
+    GLSHELL_MESSAGE_OUTPUT_SCALE,
+    GLSHELL_MESSAGE_OUTPUT_MODE,
+    GLSHELL_MESSAGE_CONFIGURE,
+    GLSHELL_MESSAGE_CLOSED,
+    GLSHELL_MESSAGE_PREFERRED_SCALE,
+};
+
+// an event the protocol thread received, for the render thread to handle
+struct glshell_message {
+    enum glshell_message_type type;
+    struct timespec time;
+    uint32_t surface_id;
     struct wl_output* wl_output;
+    uint32_t args[3];
+    // an interface or output name, owned by the message
+    char* string;
 };
 
 /* Wayland code */
-struct glshell_state {
+// the compositor connection and the EGL context, shared by every glshell_t created with
+// params.share pointing at another that uses it
+struct glshell_display {
+    int references;
+    // the glshell_t instances using it, in creation order
+    struct glshell_state** instances;
+    bool initialized;
+
     /* Globals */
     struct wl_display* wl_display;
     struct wl_registry* wl_registry;
     struct wl_compositor* wl_compositor;
     struct zwlr_layer_shell_v1* zwlr_layer_shell_v1;
-    /* Objects */
-    struct wl_surface* wl_surface;
-    struct wl_egl_window* wl_egl_surface;
-    struct zwlr_layer_surface_v1* zwlr_layer_surface_v1;
+    struct wp_viewporter* wp_viewporter;
+    struct wp_fractional_scale_manager_v1* wp_fractional_scale_manager_v1;
 
-    // EGL
+    // EGL, the context is current with the surface of any instance
     EGLDisplay egl_display;
+    EGLConfig egl_config;
     EGLContext egl_context;
-    EGLSurface egl_surface;
+    struct glshell_surface* current;
+    // for another thread to build GL objects the render context then uses
+    EGLContext shared_context;
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamage;
+    bool buffer_age_supported;
 
     // outputs
     struct glshell_output_descriptor* outputs;
 
-    // data
-    char* output_name;
-    uint32_t output_width;
-    uint32_t output_height;
+    // readable when the display or a watch is, for glshell_get_fd()
+    int epoll_fd;
+    struct glshell_watch watches[GLSHELL_MAX_WATCHES];
+    int watch_count;
+    // between glshell_flush() and glshell_dispatch_pending(), wl_display_prepare_read() was
+    // called and either read_events or cancel_read has to follow
+    bool reading;
+    uint32_t last_surface_id;
+
+    // with a render thread, another thread dispatches the display's queue and records the
+    // events in the mailbox; the thread drawing frames only dispatches frame callbacks, from
+    // render_queue. the lock keeps the protocol thread from dispatching while the render thread
+    // creates or destroys objects on the display's queue
+    struct wl_event_queue* render_queue;
+    bool protocol_running;
+    pthread_t protocol_thread;
+    _Atomic bool protocol_stop;
+    int protocol_wake;
+    pthread_mutex_t dispatch_lock;
+    mailbox_t mailbox;
+    // events that didn't fit in the mailbox, in order after it (stb_ds array). the protocol
+    // thread can't wait for room while it holds dispatch_lock, which the render thread may be
+    // waiting for
+    pthread_mutex_t overflow_lock;
+    struct glshell_message* overflow;
+
+    // no compositor, every instance renders into an offscreen framebuffer. without a context
+    // that can be current without a surface, each has a 1x1 pbuffer to make it current with
+    bool headless;
+    bool surfaceless;
+
+    // stats
+    uint64_t wakeups;
+};
+
+// a glshell_t: the surfaces drawn with one set of parameters
+struct glshell_state {
+    struct glshell_display* display;
+
+    // surfaces, the one being drawn is current. outputs coming and going create and destroy
+    // them
+    glshell_params_t params;
+    struct glshell_surface** surfaces;
+    struct glshell_surface* current;
+    size_t next_surface;
 
     // time
     struct timespec start_time;
     struct timespec last_time;
     struct timespec current_time;
 
+    // frame scheduling
+    bool continuous;
+    // --interval: a timer on wall clock multiples of interval nanoseconds paces the frames
+    // instead of frame callbacks, -1 without
+    int timer_fd;
+    int64_t interval;
+
+    // headless, the single surface renders into an offscreen framebuffer
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    GLsync fences[GLSHELL_HEADLESS_FRAMES];
+    int fence_index;
+
+    // stats
+    uint64_t frames;
+    uint64_t configures;
+    double configure_latency_total;
+    double configure_latency_max;
+
     // stop
     bool stop;
 };
 
-static struct glshell_state* g_state;
+// set on the protocol thread, whose handlers only record events
+static _Thread_local bool t_protocol_thread;
+
+static void surface_size(
+    struct glshell_state* state,
+    struct glshell_output_descriptor* output_descriptor,
+    uint32_t* width,
+    uint32_t* height
+);
+static struct glshell_surface* surface_create(
+    struct glshell_state* state,
+    struct glshell_output_descriptor* output_descriptor,
+    bool bind_output
+);
+static void surface_destroy(struct glshell_state* state, struct glshell_surface* surface);
+static void display_watch_fd(
+    struct glshell_display* display,
+    int fd,
+    glshell_fd_callback_t callback,
+    void* data
+);
+static void display_unwatch_fd(struct glshell_display* display, int fd);
+static void display_destroy(struct glshell_display* display);
+
+// with a render thread, events dispatched on the protocol thread are only recorded, the render
+// thread replays them with the same handler. false when called to handle the event. string, if
+// not NULL, is copied into the message
+static bool defer_event(
+    struct glshell_display* display,
+    struct glshell_message* message,
+    const char* string
+) {
+    if (!t_protocol_thread) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &message->time);
+    message->string = string != NULL ? strdup(string) : NULL;
+    // once events spill over, later ones follow them until the render thread took the list.
+    // the mailbox event is still set then, as the render thread hasn't emptied the mailbox
+    pthread_mutex_lock(&display->overflow_lock);
+    if (arrlenu(display->overflow) > 0 || !mailbox_push(&display->mailbox, message)) {
+        arrput(display->overflow, *message);
+    }
+    pthread_mutex_unlock(&display->overflow_lock);
+    return true;
+}
+
+// the buffer holds the real pixel count times the render scale, the viewport (or the integer
+// buffer scale without viewporter) maps it back to the logical size in the compositor
+static void surface_update_buffer(struct glshell_surface* surface) {
+    struct glshell_state* state = surface->state;
+    uint32_t width, height;
+
+    if (surface->wp_viewport != NULL) {
+        float scale = surface->scale120 / 120.0f * state->params.render_scale;
+        width = lroundf(surface->logical_width * scale);
+        height = lroundf(surface->logical_height * scale);
+        wp_viewport_set_destination(
+            surface->wp_viewport,
+            surface->logical_width,
+            surface->logical_height
+        );
+    } else {
+        int32_t buffer_scale = (surface->scale120 + 119) / 120;
+        width = surface->logical_width * buffer_scale;
+        height = surface->logical_height * buffer_scale;
+        wl_surface_set_buffer_scale(surface->wl_surface, buffer_scale);
+    }
+    width = width > 0 ? width : 1;
+    height = height > 0 ? height : 1;
+
+    // the GL context and program survive, only the window changes size
+    if (width != surface->width || height != surface->height) {
+        surface->width = width;
+        surface->height = height;
+        wl_egl_window_resize(surface->wl_egl_surface, width, height, 0, 0);
+        printf(
+            "[glshell] surface %dx%d at scale %.2f, rendering %dx%d\n",
+            surface->logical_width,
+            surface->logical_height,
+            surface->scale120 / 120.0f,
+            width,
+            height
+        );
+    }
+    surface->full_damage = true;
+}
+
+// ask for a frame to show a new size or scale, unless one is already on its way
+static void surface_schedule_redraw(struct glshell_surface* surface) {
+    if (surface->frame_callback == NULL) {
+        surface->frame_ready = true;
+    }
+}
 
 static void zwlr_layer_surface_configure(
     void* data,
@@ -64,38 +331,125 @@ static void zwlr_layer_surface_configure(
     uint32_t width,
     uint32_t height
 ) {
-    struct glshell_state* state = data;
+    struct glshell_surface* surface = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_CONFIGURE,
+        .surface_id = surface->id,
+        .args = { serial, width, height },
+    };
+    if (defer_event(surface->state->display, &message, NULL)) {
+        return;
+    }
+
     zwlr_layer_surface_v1_ack_configure(zwlr_layer_surface_v1, serial);
     zwlr_layer_surface_v1_set_size(zwlr_layer_surface_v1, width, height);
 
-    // struct wl_buffer* buffer = draw_frame(state);
-    // wl_surface_attach(state->wl_surface, buffer, 0, 0);
-    wl_surface_commit(state->wl_surface);
+    if (width != 0 && height != 0) {
+        surface->logical_width = width;
+        surface->logical_height = height;
+    }
+    surface_update_buffer(surface);
+
+    // the compositor expects a new buffer after every configure; if a frame callback is still
+    // pending, the ack is applied with the frame drawn once it fires
+    surface->configured = true;
+    surface_schedule_redraw(surface);
+    if (surface->configure_time.tv_sec == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &surface->configure_time);
+    }
+}
+
+static void
+zwlr_layer_surface_closed(void* data, struct zwlr_layer_surface_v1* zwlr_layer_surface_v1) {
+    (void)zwlr_layer_surface_v1;
+    struct glshell_surface* surface = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_CLOSED,
+        .surface_id = surface->id,
+    };
+    if (defer_event(surface->state->display, &message, NULL)) {
+        return;
+    }
+
+    // sent when our output is unplugged, the surface won't be shown again
+    printf("[glshell] surface closed by the compositor\n");
+    surface_destroy(surface->state, surface);
 }
 
 static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
     .configure = zwlr_layer_surface_configure,
+    .closed = zwlr_layer_surface_closed,
 };
 
-static void wl_output_name(void* data, struct wl_output* wl_output, const char* name) {
-    struct glshell_state* state = data;
-    for (size_t i = 0; i < arrlenu(state->outputs); i++) {
-        struct glshell_output_descriptor* output_descriptor = &state->outputs[i];
-        if (output_descriptor->wl_output == wl_output) {
-            output_descriptor->name = strdup(name);
-            return;
+static void wp_fractional_scale_preferred_scale(
+    void* data,
+    struct wp_fractional_scale_v1* wp_fractional_scale_v1,
+    uint32_t scale
+) {
+    (void)wp_fractional_scale_v1;
+    struct glshell_surface* surface = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_PREFERRED_SCALE,
+        .surface_id = surface->id,
+        .args = { scale },
+    };
+    if (defer_event(surface->state->display, &message, NULL)) {
+        return;
+    }
+
+    if (scale == surface->scale120) {
+        return;
+    }
+
+    surface->scale120 = scale;
+    if (surface->configured) {
+        surface_update_buffer(surface);
+        surface_schedule_redraw(surface);
+    }
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+    .preferred_scale = wp_fractional_scale_preferred_scale,
+};
+
+static void wl_surface_frame_done(void* data, struct wl_callback* wl_callback, uint32_t time) {
+    (void)time;
+    struct glshell_surface* surface = data;
+    wl_callback_destroy(wl_callback);
+    surface->frame_callback = NULL;
+    surface->frame_ready = true;
+}
+
+static const struct wl_callback_listener frame_callback_listener = {
+    .done = wl_surface_frame_done,
+};
+
+static struct glshell_output_descriptor*
+find_output(struct glshell_display* display, struct wl_output* wl_output) {
+    for (size_t i = 0; i < arrlenu(display->outputs); i++) {
+        if (display->outputs[i].wl_output == wl_output) {
+            return &display->outputs[i];
         }
     }
-    struct glshell_output_descriptor output_descriptor = {
-        .name = strdup(name),
-        .width = 0,
-        .height = 0,
+    return NULL;
+}
+
+static void wl_output_name(void* data, struct wl_output* wl_output, const char* name) {
+    struct glshell_display* display = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_OUTPUT_NAME,
         .wl_output = wl_output,
     };
-    arrput(state->outputs, output_descriptor);
+    if (defer_event(display, &message, name)) {
+        return;
+    }
+
+    struct glshell_output_descriptor* output_descriptor = find_output(display, wl_output);
+    free(output_descriptor->name);
+    output_descriptor->name = strdup(name);
 }
 
-// we need to fill in all the fields, but we only care about the name and width/height
+// we need to fill in all the fields, but we only care about the name, width/height and scale
 
 static void
 wl_output_description(void* data, struct wl_output* wl_output, const char* description) {
@@ -104,15 +458,100 @@ wl_output_description(void* data, struct wl_output* wl_output, const char* descr
     (void)description;
 }
 
+// the surfaces of one instance following a change of the output, or one that was plugged in
+static void instance_output_done(
+    struct glshell_state* state,
+    struct glshell_output_descriptor* output_descriptor
+) {
+    struct wl_output* wl_output = output_descriptor->wl_output;
+    bool has_surface = false;
+    for (size_t i = 0; i < arrlenu(state->surfaces); i++) {
+        struct glshell_surface* surface = state->surfaces[i];
+        if (surface->wl_output != wl_output) {
+            continue;
+        }
+        has_surface = has_surface || surface->bound;
+
+        // a mode change; the compositor answers the new size with a configure. surfaces
+        // stretched between their anchors get one without asking
+        uint32_t width, height;
+        surface_size(state, output_descriptor, &width, &height);
+        if (width != surface->requested_width || height != surface->requested_height) {
+            printf(
+                "[glshell] output %s changed to %dx%d\n",
+                output_descriptor->name,
+                output_descriptor->width,
+                output_descriptor->height
+            );
+            surface->requested_width = width;
+            surface->requested_height = height;
+            zwlr_layer_surface_v1_set_size(surface->zwlr_layer_surface_v1, width, height);
+            wl_surface_commit(surface->wl_surface);
+        }
+
+        // without fractional scaling the output scale is all we know
+        uint32_t scale120 = output_descriptor->scale * 120;
+        if (surface->wp_fractional_scale_v1 == NULL && scale120 != surface->scale120) {
+            surface->scale120 = scale120;
+            if (surface->configured) {
+                surface_update_buffer(surface);
+                surface_schedule_redraw(surface);
+            }
+        }
+    }
+
+    if (has_surface || state->params.no_surfaces) {
+        return;
+    }
+
+    // a hotplugged output that should get an overlay
+    const char* wanted = state->params.output_name;
+    if (state->params.all_outputs) {
+        printf("[glshell] output %s added\n", output_descriptor->name);
+        surface_create(state, output_descriptor, true);
+    } else if (wanted != NULL && strcmp(wanted, output_descriptor->name) == 0) {
+        printf("[glshell] output %s is back\n", output_descriptor->name);
+        surface_create(state, output_descriptor, true);
+    } else if (wanted == NULL && arrlenu(state->surfaces) == 0) {
+        printf("[glshell] using new default output %s\n", output_descriptor->name);
+        surface_create(state, output_descriptor, false);
+    }
+}
+
 static void wl_output_done(void* data, struct wl_output* wl_output) {
-    (void)data;
-    (void)wl_output;
+    struct glshell_display* display = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_OUTPUT_DONE,
+        .wl_output = wl_output,
+    };
+    if (defer_event(display, &message, NULL)) {
+        return;
+    }
+
+    struct glshell_output_descriptor* output_descriptor = find_output(display, wl_output);
+    // outputs present at startup are handled by glshell_create()
+    if (!display->initialized || output_descriptor->name == NULL ||
+        output_descriptor->width == 0 || output_descriptor->height == 0) {
+        return;
+    }
+    for (size_t i = 0; i < arrlenu(display->instances); i++) {
+        instance_output_done(display->instances[i], output_descriptor);
+    }
 }
 
 static void wl_output_scale(void* data, struct wl_output* wl_output, int32_t scale) {
-    (void)data;
-    (void)wl_output;
-    (void)scale;
+    struct glshell_display* display = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_OUTPUT_SCALE,
+        .wl_output = wl_output,
+        .args = { scale },
+    };
+    if (defer_event(display, &message, NULL)) {
+        return;
+    }
+
+    struct glshell_output_descriptor* output_descriptor = find_output(display, wl_output);
+    output_descriptor->scale = scale;
 }
 
 static void wl_output_geometry(
@@ -147,29 +586,26 @@ static void wl_output_mode(
     int32_t height,
     int32_t refresh
 ) {
-    (void)data;
-    (void)wl_output;
-    (void)flags;
     (void)refresh;
 
-    struct glshell_state* state = data;
-    for (size_t i = 0; i < arrlenu(state->outputs); i++) {
-        struct glshell_output_descriptor* output_descriptor = &state->outputs[i];
-        if (output_descriptor->wl_output == wl_output) {
-            output_descriptor->width = width;
-            output_descriptor->height = height;
-            return;
-        }
+    // outputs may also advertise modes they are not using
+    if (!(flags & WL_OUTPUT_MODE_CURRENT)) {
+        return;
     }
 
-    struct glshell_output_descriptor output_descriptor = {
-        .name = NULL,
-        .width = width,
-        .height = height,
+    struct glshell_display* display = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_OUTPUT_MODE,
         .wl_output = wl_output,
+        .args = { flags, width, height },
     };
+    if (defer_event(display, &message, NULL)) {
+        return;
+    }
 
-    arrput(state->outputs, output_descriptor);
+    struct glshell_output_descriptor* output_descriptor = find_output(display, wl_output);
+    output_descriptor->width = width;
+    output_descriptor->height = height;
 }
 
 static const struct wl_output_listener wl_output_listener = {
@@ -188,26 +624,93 @@ static void registry_global(
     const char* interface,
     uint32_t version
 ) {
-    (void)version;
-    struct glshell_state* state = data;
+    struct glshell_display* display = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_GLOBAL,
+        .args = { name, version },
+    };
+    if (defer_event(display, &message, interface)) {
+        return;
+    }
+
     if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->wl_compositor =
+        display->wl_compositor =
             wl_registry_bind(wl_registry, name, &wl_compositor_interface, version);
     } else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
-        state->zwlr_layer_shell_v1 =
+        display->zwlr_layer_shell_v1 =
             wl_registry_bind(wl_registry, name, &zwlr_layer_shell_v1_interface, version);
+    } else if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+        display->wp_viewporter =
+            wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1);
+    } else if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) == 0) {
+        display->wp_fractional_scale_manager_v1 = wl_registry_bind(
+            wl_registry,
+            name,
+            &wp_fractional_scale_manager_v1_interface,
+            1
+        );
     } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        // version 4 added the name event
+        uint32_t output_version = version < 4 ? version : 4;
         struct wl_output* wl_output =
-            wl_registry_bind(wl_registry, name, &wl_output_interface, version);
-        wl_output_add_listener(wl_output, &wl_output_listener, state);
+            wl_registry_bind(wl_registry, name, &wl_output_interface, output_version);
+        struct glshell_output_descriptor output_descriptor = {
+            .name = NULL,
+            .width = 0,
+            .height = 0,
+            .scale = 1,
+            .wl_output = wl_output,
+            .global_name = name,
+        };
+        arrput(display->outputs, output_descriptor);
+        wl_output_add_listener(wl_output, &wl_output_listener, display);
     }
 }
 
 static void registry_global_remove(void* data, struct wl_registry* wl_registry, uint32_t name) {
-    (void)data;
     (void)wl_registry;
-    (void)name;
-    /* This space deliberately left blank */
+    struct glshell_display* display = data;
+    struct glshell_message message = {
+        .type = GLSHELL_MESSAGE_GLOBAL_REMOVE,
+        .args = { name },
+    };
+    if (defer_event(display, &message, NULL)) {
+        return;
+    }
+
+    for (size_t i = 0; i < arrlenu(display->outputs); i++) {
+        struct glshell_output_descriptor* output_descriptor = &display->outputs[i];
+        if (output_descriptor->global_name != name) {
+            continue;
+        }
+
+        printf(
+            "[glshell] output %s removed\n",
+            output_descriptor->name != NULL ? output_descriptor->name : "(unnamed)"
+        );
+
+        // surfaces placed by the compositor get a closed event instead, they only lose the
+        // output their size came from
+        for (size_t k = 0; k < arrlenu(display->instances); k++) {
+            struct glshell_state* state = display->instances[k];
+            for (size_t j = arrlenu(state->surfaces); j > 0; j--) {
+                struct glshell_surface* surface = state->surfaces[j - 1];
+                if (surface->wl_output != output_descriptor->wl_output) {
+                    continue;
+                }
+                if (surface->bound) {
+                    surface_destroy(state, surface);
+                } else {
+                    surface->wl_output = NULL;
+                }
+            }
+        }
+
+        free(output_descriptor->name);
+        wl_output_destroy(output_descriptor->wl_output);
+        arrdel(display->outputs, i);
+        return;
+    }
 }
 
 static const struct wl_registry_listener wl_registry_listener = {
@@ -215,150 +718,759 @@ static const struct wl_registry_listener wl_registry_listener = {
     .global_remove = registry_global_remove,
 };
 
-void glshell_init(glshell_params_t* params) {
-    struct glshell_state* state = malloc(sizeof(struct glshell_state));
-    g_state = state;
-
-    if (params->output_name != NULL) {
-        state->output_name = params->output_name;
+static struct glshell_surface* find_surface(struct glshell_display* display, uint32_t id) {
+    for (size_t i = 0; i < arrlenu(display->instances); i++) {
+        struct glshell_state* state = display->instances[i];
+        for (size_t j = 0; j < arrlenu(state->surfaces); j++) {
+            if (state->surfaces[j]->id == id) {
+                return state->surfaces[j];
+            }
+        }
     }
+    return NULL;
+}
 
-    state->wl_display = wl_display_connect(NULL);
-    state->wl_registry = wl_display_get_registry(state->wl_display);
-    wl_registry_add_listener(state->wl_registry, &wl_registry_listener, state);
-    wl_display_roundtrip(state->wl_display);
-
-    state->wl_surface = wl_compositor_create_surface(state->wl_compositor);
-    struct wl_region* region = wl_compositor_create_region(state->wl_compositor);
-    wl_surface_set_input_region(state->wl_surface, region);
-    wl_region_destroy(region);
+static void replay_message(struct glshell_display* display, struct glshell_message* message) {
+    // events may still arrive for a surface or output that was destroyed in the meantime
+    struct glshell_surface* surface = find_surface(display, message->surface_id);
+    if ((message->surface_id != 0 && surface == NULL) ||
+        (message->wl_output != NULL && find_output(display, message->wl_output) == NULL)) {
+        return;
+    }
 
-    struct wl_output* output = NULL;
+    switch (message->type) {
+    case GLSHELL_MESSAGE_GLOBAL:
+        registry_global(
+            display,
+            display->wl_registry,
+            message->args[0],
+            message->string,
+            message->args[1]
+        );
+        break;
+    case GLSHELL_MESSAGE_GLOBAL_REMOVE:
+        registry_global_remove(display, display->wl_registry, message->args[0]);
+        break;
+    case GLSHELL_MESSAGE_OUTPUT_NAME:
+        wl_output_name(display, message->wl_output, message->string);
+        break;
+    case GLSHELL_MESSAGE_OUTPUT_DONE:
+        wl_output_done(display, message->wl_output);
+        break;
+    case GLSHELL_MESSAGE_OUTPUT_SCALE:
+        wl_output_scale(display, message->wl_output, message->args[0]);
+        break;
+    case GLSHELL_MESSAGE_OUTPUT_MODE:
+        wl_output_mode(
+            display,
+            message->wl_output,
+            message->args[0],
+            message->args[1],
+            message->args[2],
+            0
+        );
+        break;
+    case GLSHELL_MESSAGE_CONFIGURE: {
+        // the latency counts from when the event arrived, not from when it was replayed
+        bool answered = surface->configure_time.tv_sec == 0;
+        zwlr_layer_surface_configure(
+            surface,
+            surface->zwlr_layer_surface_v1,
+            message->args[0],
+            message->args[1],
+            message->args[2]
+        );
+        if (answered) {
+            surface->configure_time = message->time;
+        }
+        break;
+    }
+    case GLSHELL_MESSAGE_CLOSED:
+        zwlr_layer_surface_closed(surface, surface->zwlr_layer_surface_v1);
+        break;
+    case GLSHELL_MESSAGE_PREFERRED_SCALE:
+        wp_fractional_scale_preferred_scale(
+            surface,
+            surface->wp_fractional_scale_v1,
+            message->args[0]
+        );
+        break;
+    }
+}
 
-    wl_display_dispatch(state->wl_display);
+// on the render thread, from glshell_dispatch_pending()
+static void replay_messages(void* data) {
+    struct glshell_display* display = data;
+    struct glshell_message message;
+    while (true) {
+        while (mailbox_pop(&display->mailbox, &message)) {
+            pthread_mutex_lock(&display->dispatch_lock);
+            replay_message(display, &message);
+            pthread_mutex_unlock(&display->dispatch_lock);
+            free(message.string);
+        }
 
-    for (size_t i = 0; i < arrlenu(state->outputs); i++) {
-        struct glshell_output_descriptor* output_descriptor = &state->outputs[i];
-        if (output_descriptor->name == NULL) {
-            printf("[glshell] error: output %zu has no name\n", i);
-            exit(1);
+        // the mailbox is empty, so the overflow holds the events after it. events recorded
+        // meanwhile go to the mailbox again and are popped after these
+        pthread_mutex_lock(&display->overflow_lock);
+        struct glshell_message* overflow = display->overflow;
+        display->overflow = NULL;
+        pthread_mutex_unlock(&display->overflow_lock);
+        if (overflow == NULL) {
+            break;
         }
-        if (output_descriptor->width == 0 || output_descriptor->height == 0) {
-            printf(
-                "[glshell] error: output %s has invalid dimensions\n",
-                output_descriptor->name
-            );
-            exit(1);
+        for (size_t i = 0; i < arrlenu(overflow); i++) {
+            pthread_mutex_lock(&display->dispatch_lock);
+            replay_message(display, &overflow[i]);
+            pthread_mutex_unlock(&display->dispatch_lock);
+            free(overflow[i].string);
         }
-
-        printf(
-            "[glshell] output %s: %dx%d\n",
-            output_descriptor->name,
-            output_descriptor->width,
-            output_descriptor->height
-        );
+        arrfree(overflow);
     }
+}
 
-    if (params->output_name != NULL) {
-        for (size_t i = 0; i < arrlenu(state->outputs); i++) {
-            struct glshell_output_descriptor* output_descriptor = &state->outputs[i];
-            if (strcmp(output_descriptor->name, params->output_name) == 0) {
-                output = output_descriptor->wl_output;
-                state->output_width = output_descriptor->width;
-                state->output_height = output_descriptor->height;
+// reads and dispatches the display's queue, however long the render thread takes to draw. the
+// render thread reads from the same socket for its frame callbacks, libwayland hands every
+// event to the right queue whichever thread reads it
+static void* protocol_thread_run(void* data) {
+    struct glshell_display* display = data;
+    t_protocol_thread = true;
 
-                params->width = state->output_width;
-                params->height = state->output_height;
+    struct pollfd pfds[2] = {
+        { .fd = wl_display_get_fd(display->wl_display), .events = POLLIN },
+        { .fd = display->protocol_wake, .events = POLLIN },
+    };
+    while (!atomic_load(&display->protocol_stop)) {
+        int ret = 0;
+        pthread_mutex_lock(&display->dispatch_lock);
+        while (ret != -1 && wl_display_prepare_read(display->wl_display) != 0) {
+            ret = wl_display_dispatch_pending(display->wl_display);
+        }
+        pthread_mutex_unlock(&display->dispatch_lock);
+        if (ret == -1) {
+            break;
+        }
+        wl_display_flush(display->wl_display);
+
+        poll(pfds, 2, -1);
+        if (pfds[0].revents & POLLIN) {
+            if (wl_display_read_events(display->wl_display) == -1) {
                 break;
             }
+        } else {
+            wl_display_cancel_read(display->wl_display);
         }
 
-        if (output == NULL) {
-            printf("[glshell] error: output %s not found\n", params->output_name);
-            exit(1);
-        }
-        if (state->output_width == 0 || state->output_height == 0) {
-            printf("[glshell] error: output %s has invalid dimensions\n", params->output_name);
-            exit(1);
-        }
-    } else {
-        printf("[glshell] output not specified\n");
-        printf("[glshell] using default output\n");
-        struct glshell_output_descriptor* output_descriptor = &state->outputs[0];
-        state->output_width = output_descriptor->width;
-        state->output_height = output_descriptor->height;
-        printf(
-            "[glshell] default output chosen: %s (%dx%d)\n",
-            output_descriptor->name,
-            output_descriptor->width,
-            output_descriptor->height
-        );
-        if (params->width == 0) {
-            params->width = state->output_width;
-            printf("[glshell] using default width: %d\n", params->width);
+        pthread_mutex_lock(&display->dispatch_lock);
+        ret = wl_display_dispatch_pending(display->wl_display);
+        pthread_mutex_unlock(&display->dispatch_lock);
+        if (ret == -1) {
+            break;
         }
-        if (params->height == 0) {
-            params->height = state->output_height;
-            printf("[glshell] using default height: %d\n", params->height);
+    }
+    // a lost connection also fails the render thread's next read
+    return NULL;
+}
+
+static void protocol_thread_start(struct glshell_display* display) {
+    mailbox_init(&display->mailbox, sizeof(struct glshell_message), GLSHELL_MAILBOX_SIZE);
+    pthread_mutex_init(&display->dispatch_lock, NULL);
+    pthread_mutex_init(&display->overflow_lock, NULL);
+    display->overflow = NULL;
+    display->protocol_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    atomic_init(&display->protocol_stop, false);
+    display_watch_fd(display, display->mailbox.event, replay_messages, display);
+
+    if (display->protocol_wake == -1 ||
+        pthread_create(&display->protocol_thread, NULL, protocol_thread_run, display) != 0) {
+        printf("[glshell] error: unable to start the protocol thread\n");
+        exit(1);
+    }
+    display->protocol_running = true;
+    printf("[glshell] dispatching protocol events on their own thread\n");
+}
+
+static void protocol_thread_stop(struct glshell_display* display) {
+    atomic_store(&display->protocol_stop, true);
+    uint64_t one = 1;
+    write(display->protocol_wake, &one, sizeof(one));
+    pthread_join(display->protocol_thread, NULL);
+    display->protocol_running = false;
+
+    // events recorded too late to matter
+    struct glshell_message message;
+    while (mailbox_pop(&display->mailbox, &message)) {
+        free(message.string);
+    }
+    for (size_t i = 0; i < arrlenu(display->overflow); i++) {
+        free(display->overflow[i].string);
+    }
+    arrfree(display->overflow);
+    mailbox_destroy(&display->mailbox);
+    close(display->protocol_wake);
+    pthread_mutex_destroy(&display->dispatch_lock);
+    pthread_mutex_destroy(&display->overflow_lock);
+}
+
+static bool has_egl_extension(EGLDisplay egl_display, const char* name) {
+    const char* extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+    size_t length = strlen(name);
+    while (extensions != NULL && (extensions = strstr(extensions, name)) != NULL) {
+        if (extensions[length] == ' ' || extensions[length] == '\0') {
+            return true;
         }
+        extensions += length;
+    }
+    return false;
+}
+
+static const char* egl_error_string(EGLint egl_error) {
+    switch (egl_error) {
+        case EGL_BAD_DISPLAY:
+            return "EGL_BAD_DISPLAY";
+        case EGL_NOT_INITIALIZED:
+            return "EGL_NOT_INITIALIZED";
+        case EGL_BAD_CONFIG:
+            return "EGL_BAD_CONFIG";
+        case EGL_BAD_NATIVE_WINDOW:
+            return "EGL_BAD_NATIVE_WINDOW";
+        case EGL_BAD_ATTRIBUTE:
+            return "EGL_BAD_ATTRIBUTE";
+        case EGL_BAD_ALLOC:
+            return "EGL_BAD_ALLOC";
+        case EGL_BAD_MATCH:
+            return "EGL_BAD_MATCH";
+        case EGL_BAD_SURFACE:
+            return "EGL_BAD_SURFACE";
+        case EGL_BAD_CURRENT_SURFACE:
+            return "EGL_BAD_CURRENT_SURFACE";
+        case EGL_BAD_CONTEXT:
+            return "EGL_BAD_CONTEXT";
+        case EGL_BAD_NATIVE_PIXMAP:
+            return "EGL_BAD_NATIVE_PIXMAP";
+        case EGL_CONTEXT_LOST:
+            return "EGL_CONTEXT_LOST";
+        default:
+            return "unknown";
+    }
+}
+
+// without a surface the context is current on its own, which needs
+// EGL_KHR_surfaceless_context
+static void make_current(struct glshell_display* display, struct glshell_surface* surface) {
+    if (display->current == surface && surface != NULL) {
+        return;
+    }
+
+    EGLSurface egl_surface = surface != NULL ? surface->egl_surface : EGL_NO_SURFACE;
+    if (!eglMakeCurrent(display->egl_display, egl_surface, egl_surface, display->egl_context)) {
+        printf("[glshell] error: failed to make EGL context current\n");
+        exit(1);
+    }
+    display->current = surface;
+}
+
+static uint32_t surface_extent(
+    glshell_params_t* params,
+    int size,
+    bool stretched,
+    uint32_t output_size,
+    int32_t output_scale
+) {
+    if (size != 0) {
+        return size - 2 * params->margin;
+    }
+    if (stretched) {
+        return 0;
+    }
+    // modes are in physical pixels, the layer surface size is logical
+    return output_size / output_scale - 2 * params->margin;
+}
+
+static void surface_size(
+    struct glshell_state* state,
+    struct glshell_output_descriptor* output_descriptor,
+    uint32_t* width,
+    uint32_t* height
+) {
+    glshell_params_t* params = &state->params;
+    int32_t scale = output_descriptor->scale > 0 ? output_descriptor->scale : 1;
+    bool stretch_x = (params->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT) &&
+                     (params->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+    bool stretch_y = (params->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP) &&
+                     (params->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM);
+    *width = surface_extent(params, params->width, stretch_x, output_descriptor->width, scale);
+    *height =
+        surface_extent(params, params->height, stretch_y, output_descriptor->height, scale);
+}
+
+static struct glshell_surface* surface_create(
+    struct glshell_state* state,
+    struct glshell_output_descriptor* output_descriptor,
+    bool bind_output
+) {
+    struct glshell_display* display = state->display;
+    glshell_params_t* params = &state->params;
+    struct glshell_surface* surface = calloc(1, sizeof(struct glshell_surface));
+    surface->state = state;
+    surface->id = ++display->last_surface_id;
+    surface->wl_output = output_descriptor->wl_output;
+    surface->bound = bind_output;
+    surface_size(
+        state,
+        output_descriptor,
+        &surface->requested_width,
+        &surface->requested_height
+    );
+
+    // a guess until the first configure, stretched surfaces fill the output
+    int32_t scale = output_descriptor->scale > 0 ? output_descriptor->scale : 1;
+    surface->logical_width = surface->requested_width != 0
+                                 ? surface->requested_width
+                                 : output_descriptor->width / scale - 2 * params->margin;
+    surface->logical_height = surface->requested_height != 0
+                                  ? surface->requested_height
+                                  : output_descriptor->height / scale - 2 * params->margin;
+    surface->scale120 = scale * 120;
+
+    surface->wl_surface = wl_compositor_create_surface(display->wl_compositor);
+    surface->frame_surface = surface->wl_surface;
+    if (display->render_queue != NULL) {
+        surface->frame_surface = wl_proxy_create_wrapper(surface->wl_surface);
+        wl_proxy_set_queue((struct wl_proxy*)surface->frame_surface, display->render_queue);
     }
+    struct wl_region* region = wl_compositor_create_region(display->wl_compositor);
+    wl_surface_set_input_region(surface->wl_surface, region);
+    if (params->opaque) {
+        // the region is clipped to the surface, so it can be set before the size is known
+        wl_region_add(region, 0, 0, INT32_MAX, INT32_MAX);
+        wl_surface_set_opaque_region(surface->wl_surface, region);
+    }
+    wl_region_destroy(region);
 
-    uint32_t surface_width = params->width - 2 * params->margin;
-    uint32_t surface_height = params->height - 2 * params->margin;
+    if (display->wp_viewporter != NULL) {
+        surface->wp_viewport =
+            wp_viewporter_get_viewport(display->wp_viewporter, surface->wl_surface);
+    }
+    if (display->wp_fractional_scale_manager_v1 != NULL) {
+        surface->wp_fractional_scale_v1 = wp_fractional_scale_manager_v1_get_fractional_scale(
+            display->wp_fractional_scale_manager_v1,
+            surface->wl_surface
+        );
+        wp_fractional_scale_v1_add_listener(
+            surface->wp_fractional_scale_v1,
+            &fractional_scale_listener,
+            surface
+        );
+    }
 
-    state->wl_egl_surface =
-        wl_egl_window_create(state->wl_surface, surface_width, surface_height);
+    surface->wl_egl_surface = wl_egl_window_create(
+        surface->wl_surface,
+        surface->logical_width,
+        surface->logical_height
+    );
+    surface_update_buffer(surface);
 
-    state->zwlr_layer_surface_v1 = zwlr_layer_shell_v1_get_layer_surface(
-        state->zwlr_layer_shell_v1,
-        state->wl_surface,
-        output,
+    surface->zwlr_layer_surface_v1 = zwlr_layer_shell_v1_get_layer_surface(
+        display->zwlr_layer_shell_v1,
+        surface->wl_surface,
+        surface->bound ? surface->wl_output : NULL,
         params->layer,
         PROJECT_NAME
     );
-    zwlr_layer_surface_v1_set_size(state->zwlr_layer_surface_v1, surface_width, surface_height);
-    zwlr_layer_surface_v1_set_anchor(state->zwlr_layer_surface_v1, params->anchor);
+    zwlr_layer_surface_v1_set_size(
+        surface->zwlr_layer_surface_v1,
+        surface->requested_width,
+        surface->requested_height
+    );
+    zwlr_layer_surface_v1_set_anchor(surface->zwlr_layer_surface_v1, params->anchor);
     zwlr_layer_surface_v1_set_margin(
-        state->zwlr_layer_surface_v1,
+        surface->zwlr_layer_surface_v1,
         params->margin,
         params->margin,
         params->margin,
         params->margin
     );
     if (params->reserve) {
-        zwlr_layer_surface_v1_set_exclusive_zone(state->zwlr_layer_surface_v1, -1);
+        zwlr_layer_surface_v1_set_exclusive_zone(surface->zwlr_layer_surface_v1, -1);
     } else {
-        zwlr_layer_surface_v1_set_exclusive_zone(state->zwlr_layer_surface_v1, 0);
+        zwlr_layer_surface_v1_set_exclusive_zone(surface->zwlr_layer_surface_v1, 0);
     }
-    zwlr_layer_surface_v1_set_keyboard_interactivity(state->zwlr_layer_surface_v1, 0);
+    zwlr_layer_surface_v1_set_keyboard_interactivity(surface->zwlr_layer_surface_v1, 0);
     zwlr_layer_surface_v1_add_listener(
-        state->zwlr_layer_surface_v1,
+        surface->zwlr_layer_surface_v1,
         &layer_surface_listener,
-        state
+        surface
     );
 
-    wl_surface_commit(state->wl_surface);
+    wl_surface_commit(surface->wl_surface);
 
-    if (!eglBindAPI(EGL_OPENGL_API)) {
-        printf("[glshell] error: failed to bind OpenGL API\n");
-        exit(1);
-    }
+    surface->egl_surface = eglCreateWindowSurface(
+        display->egl_display,
+        display->egl_config,
+        (EGLNativeWindowType)surface->wl_egl_surface,
+        0
+    );
 
-    state->egl_display = eglGetDisplay(state->wl_display);
-    if (state->egl_display == EGL_NO_DISPLAY) {
-        printf("[glshell] error: failed to get EGL display\n");
+    if (surface->egl_surface == EGL_NO_SURFACE) {
+        printf("[glshell] error: failed to create EGL surface\n");
+        printf("[glshell] EGL error: %s\n", egl_error_string(eglGetError()));
         exit(1);
     }
 
-    EGLint major, minor;
+    // frames are paced by wl_surface.frame callbacks instead, so swapping must never block.
+    // the swap interval belongs to the surface that is current when it is set
+    make_current(display, surface);
+    eglSwapInterval(display->egl_display, 0);
 
-    if (!eglInitialize(state->egl_display, &major, &minor)) {
-        printf("[glshell] error: failed to initialize EGL\n");
-        exit(1);
+    printf(
+        "[glshell] surface on output %s: %dx%d\n",
+        bind_output ? output_descriptor->name : "(compositor default)",
+        surface->logical_width,
+        surface->logical_height
+    );
+
+    arrput(state->surfaces, surface);
+    return surface;
+}
+
+static void surface_destroy(struct glshell_state* state, struct glshell_surface* surface) {
+    struct glshell_display* display = state->display;
+    if (display->current == surface) {
+        eglMakeCurrent(
+            display->egl_display,
+            EGL_NO_SURFACE,
+            EGL_NO_SURFACE,
+            display->egl_context
+        );
+        display->current = NULL;
+    }
+    if (state->current == surface) {
+        state->current = NULL;
     }
 
-    EGLint total_configs;
-    EGLConfig egl_config;
+    if (surface->frame_callback != NULL) {
+        wl_callback_destroy(surface->frame_callback);
+    }
+    if (surface->frame_surface != surface->wl_surface) {
+        wl_proxy_wrapper_destroy(surface->frame_surface);
+    }
+    eglDestroySurface(display->egl_display, surface->egl_surface);
+    wl_egl_window_destroy(surface->wl_egl_surface);
+    if (surface->wp_viewport != NULL) {
+        wp_viewport_destroy(surface->wp_viewport);
+    }
+    if (surface->wp_fractional_scale_v1 != NULL) {
+        wp_fractional_scale_v1_destroy(surface->wp_fractional_scale_v1);
+    }
+    zwlr_layer_surface_v1_destroy(surface->zwlr_layer_surface_v1);
+    wl_surface_destroy(surface->wl_surface);
+
+    for (size_t i = 0; i < arrlenu(state->surfaces); i++) {
+        if (state->surfaces[i] == surface) {
+            arrdel(state->surfaces, i);
+            break;
+        }
+    }
+    free(surface);
+}
+
+static void print_egl_info(struct glshell_display* display) {
+    printf(
+        "[glshell] EGL context client APIs: %s\n",
+        eglQueryString(display->egl_display, EGL_CLIENT_APIS)
+    );
+    printf("[glshell] EGL vendor: %s\n", eglQueryString(display->egl_display, EGL_VENDOR));
+    printf("[glshell] EGL version: %s\n", eglQueryString(display->egl_display, EGL_VERSION));
+}
+
+/* Headless code */
+static void headless_display_init(struct glshell_display* display) {
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        printf("[glshell] error: failed to bind OpenGL API\n");
+        exit(1);
+    }
+
+    // a display without any window system behind it works on machines with neither a GPU
+    // nor a display server, e.g. with llvmpipe
+    if (has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        display->egl_display =
+            eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    } else {
+        display->egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display->egl_display == EGL_NO_DISPLAY) {
+        printf("[glshell] error: failed to get EGL display\n");
+        exit(1);
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(display->egl_display, &major, &minor)) {
+        printf("[glshell] error: failed to initialize EGL\n");
+        exit(1);
+    }
+
+    // rendering goes to a framebuffer object, so no EGL surface is needed where the context
+    // can be made current without one. otherwise a 1x1 pbuffer stands in
+    display->surfaceless =
+        has_egl_extension(display->egl_display, "EGL_KHR_surfaceless_context");
+    display->egl_config = EGL_NO_CONFIG_KHR;
+    if (!display->surfaceless ||
+        !has_egl_extension(display->egl_display, "EGL_KHR_no_config_context")) {
+        EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE,
+            EGL_PBUFFER_BIT,
+            EGL_RED_SIZE,
+            8,
+            EGL_GREEN_SIZE,
+            8,
+            EGL_BLUE_SIZE,
+            8,
+            EGL_RENDERABLE_TYPE,
+            EGL_OPENGL_BIT,
+            EGL_NONE,
+        };
+        EGLint total_configs;
+        if (!eglChooseConfig(
+                display->egl_display,
+                config_attribs,
+                &display->egl_config,
+                1,
+                &total_configs
+            ) ||
+            total_configs == 0) {
+            printf("[glshell] error: failed to choose EGL config\n");
+            exit(1);
+        }
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION,
+        2,
+        EGL_NONE,
+    };
+    display->egl_context = eglCreateContext(
+        display->egl_display,
+        display->egl_config,
+        EGL_NO_CONTEXT,
+        context_attribs
+    );
+    if (display->egl_context == EGL_NO_CONTEXT) {
+        printf("[glshell] error: failed to create EGL context\n");
+        printf("[glshell] EGL error: %s\n", egl_error_string(eglGetError()));
+        exit(1);
+    }
+    print_egl_info(display);
+    display->headless = true;
+}
+
+static void headless_surface_create(struct glshell_state* state) {
+    struct glshell_display* display = state->display;
+    glshell_params_t* params = &state->params;
+    if (params->width <= 0 || params->height <= 0) {
+        printf("[glshell] error: headless mode needs a width and height\n");
+        exit(1);
+    }
+
+    struct glshell_surface* surface = calloc(1, sizeof(struct glshell_surface));
+    surface->state = state;
+    surface->id = ++display->last_surface_id;
+    surface->egl_surface = EGL_NO_SURFACE;
+    if (!display->surfaceless) {
+        EGLint pbuffer_attribs[] = {
+            EGL_WIDTH,
+            1,
+            EGL_HEIGHT,
+            1,
+            EGL_NONE,
+        };
+        surface->egl_surface =
+            eglCreatePbufferSurface(display->egl_display, display->egl_config, pbuffer_attribs);
+        if (surface->egl_surface == EGL_NO_SURFACE) {
+            printf("[glshell] error: failed to create EGL pbuffer\n");
+            printf("[glshell] EGL error: %s\n", egl_error_string(eglGetError()));
+            exit(1);
+        }
+    }
+    surface->logical_width = surface->width = params->width;
+    surface->logical_height = surface->height = params->height;
+    surface->scale120 = 120;
+    surface->configured = true;
+    surface->frame_ready = true;
+    surface->full_damage = true;
+    arrput(state->surfaces, surface);
+
+    printf(
+        "[glshell] headless: rendering offscreen at %dx%d (%s)\n",
+        surface->width,
+        surface->height,
+        display->surfaceless ? "surfaceless" : "pbuffer"
+    );
+}
+
+// created on first use, as the caller only loads the GL entry points after glshell_create()
+static void headless_bind_framebuffer(struct glshell_state* state) {
+    if (state->framebuffer == 0) {
+        struct glshell_surface* surface = state->surfaces[0];
+        glGenRenderbuffers(1, &state->renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, state->renderbuffer);
+        glRenderbufferStorage(
+            GL_RENDERBUFFER,
+            state->params.opaque ? GL_RGB8 : GL_RGBA8,
+            surface->width,
+            surface->height
+        );
+        glGenFramebuffers(1, &state->framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, state->framebuffer);
+        glFramebufferRenderbuffer(
+            GL_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            GL_RENDERBUFFER,
+            state->renderbuffer
+        );
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("[glshell] error: offscreen framebuffer is incomplete\n");
+            exit(1);
+        }
+        glViewport(0, 0, surface->width, surface->height);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, state->framebuffer);
+}
+
+// keeps at most GLSHELL_HEADLESS_FRAMES frames in flight like a swapchain would, so frames are
+// counted as the GPU finishes them rather than as fast as commands can be queued
+static void headless_swap(struct glshell_state* state) {
+    GLsync* fence = &state->fences[state->fence_index];
+    if (*fence != NULL) {
+        glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(*fence);
+    }
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    state->fence_index = (state->fence_index + 1) % GLSHELL_HEADLESS_FRAMES;
+}
+
+// the context is shared, so the objects can go with whichever surface is current
+static void headless_surface_destroy(struct glshell_state* state) {
+    struct glshell_display* display = state->display;
+    for (int i = 0; i < GLSHELL_HEADLESS_FRAMES; i++) {
+        if (state->fences[i] != NULL) {
+            glDeleteSync(state->fences[i]);
+        }
+    }
+    if (state->framebuffer != 0) {
+        glDeleteFramebuffers(1, &state->framebuffer);
+        glDeleteRenderbuffers(1, &state->renderbuffer);
+    }
+
+    struct glshell_surface* surface = state->surfaces[0];
+    if (display->current == surface) {
+        display->current = NULL;
+    }
+    if (surface->egl_surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display->egl_display, surface->egl_surface);
+    }
+    free(surface);
+    arrfree(state->surfaces);
+}
+
+static void headless_display_cleanup(struct glshell_display* display) {
+    eglMakeCurrent(display->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (display->shared_context != EGL_NO_CONTEXT) {
+        eglDestroyContext(display->egl_display, display->shared_context);
+    }
+    eglDestroyContext(display->egl_display, display->egl_context);
+    eglTerminate(display->egl_display);
+    eglReleaseThread();
+}
+
+static struct glshell_display* display_create(glshell_params_t* params) {
+    struct glshell_display* display = calloc(1, sizeof(struct glshell_display));
+    display->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (display->epoll_fd == -1) {
+        printf("[glshell] error: unable to create an epoll instance: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    if (params->headless) {
+        headless_display_init(display);
+        display->initialized = true;
+        return display;
+    }
+
+    display->wl_display = wl_display_connect(NULL);
+    if (display->wl_display == NULL) {
+        printf("[glshell] error: unable to connect to the Wayland display\n");
+        exit(1);
+    }
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.fd = wl_display_get_fd(display->wl_display),
+    };
+    epoll_ctl(display->epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event);
+    if (params->render_thread) {
+        display->render_queue = wl_display_create_queue(display->wl_display);
+    }
+    display->wl_registry = wl_display_get_registry(display->wl_display);
+    wl_registry_add_listener(display->wl_registry, &wl_registry_listener, display);
+    // the first roundtrip announces the globals, the second delivers the output events
+    wl_display_roundtrip(display->wl_display);
+    wl_display_roundtrip(display->wl_display);
+
+    if (arrlenu(display->outputs) == 0) {
+        printf("[glshell] error: no outputs found\n");
+        exit(1);
+    }
+
+    printf(
+        "[glshell] fractional scaling %s, viewporter %s\n",
+        display->wp_fractional_scale_manager_v1 != NULL ? "yes" : "no",
+        display->wp_viewporter != NULL ? "yes" : "no"
+    );
+
+    for (size_t i = 0; i < arrlenu(display->outputs); i++) {
+        struct glshell_output_descriptor* output_descriptor = &display->outputs[i];
+        if (output_descriptor->name == NULL) {
+            printf("[glshell] error: output %zu has no name\n", i);
+            exit(1);
+        }
+        if (output_descriptor->width == 0 || output_descriptor->height == 0) {
+            printf(
+                "[glshell] error: output %s has invalid dimensions\n",
+                output_descriptor->name
+            );
+            exit(1);
+        }
+
+        printf(
+            "[glshell] output %s: %dx%d\n",
+            output_descriptor->name,
+            output_descriptor->width,
+            output_descriptor->height
+        );
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        printf("[glshell] error: failed to bind OpenGL API\n");
+        exit(1);
+    }
+
+    display->egl_display = eglGetDisplay(display->wl_display);
+    if (display->egl_display == EGL_NO_DISPLAY) {
+        printf("[glshell] error: failed to get EGL display\n");
+        exit(1);
+    }
+
+    EGLint major, minor;
+
+    if (!eglInitialize(display->egl_display, &major, &minor)) {
+        printf("[glshell] error: failed to initialize EGL\n");
+        exit(1);
+    }
+
+    EGLint total_configs;
     EGLint config_attribs[] = {
         EGL_SURFACE_TYPE,
         EGL_WINDOW_BIT,
@@ -369,16 +1481,45 @@ void glshell_init(glshell_params_t* params) {
         EGL_BLUE_SIZE,
         8,
         EGL_ALPHA_SIZE,
-        8,
+        params->opaque ? 0 : 8,
         EGL_RENDERABLE_TYPE,
         EGL_OPENGL_BIT,
         EGL_NONE,
     };
 
-    if (!eglChooseConfig(state->egl_display, config_attribs, &egl_config, 1, &total_configs)) {
+    if (!eglChooseConfig(display->egl_display, config_attribs, NULL, 0, &total_configs) ||
+        total_configs == 0) {
         printf("[glshell] error: failed to choose EGL config\n");
         exit(1);
     }
+    EGLConfig* egl_configs = malloc(total_configs * sizeof(EGLConfig));
+    eglChooseConfig(
+        display->egl_display,
+        config_attribs,
+        egl_configs,
+        total_configs,
+        &total_configs
+    );
+
+    // EGL sorts configs with more color bits first, so an alpha-less one (XRGB) has to be
+    // picked by hand. it lets the compositor skip blending and use a scanout plane
+    display->egl_config = egl_configs[0];
+    if (params->opaque) {
+        for (EGLint i = 0; i < total_configs; i++) {
+            EGLint alpha_size;
+            eglGetConfigAttrib(
+                display->egl_display,
+                egl_configs[i],
+                EGL_ALPHA_SIZE,
+                &alpha_size
+            );
+            if (alpha_size == 0) {
+                display->egl_config = egl_configs[i];
+                break;
+            }
+        }
+    }
+    free(egl_configs);
 
     // setup for GLES instead of GL
     EGLint context_attribs[] = {
@@ -387,128 +1528,649 @@ void glshell_init(glshell_params_t* params) {
         EGL_NONE,
     };
 
-    state->egl_context =
-        eglCreateContext(state->egl_display, egl_config, EGL_NO_CONTEXT, context_attribs);
+    display->egl_context = eglCreateContext(
+        display->egl_display,
+        display->egl_config,
+        EGL_NO_CONTEXT,
+        context_attribs
+    );
 
-    if (state->egl_context == EGL_NO_CONTEXT) {
+    if (display->egl_context == EGL_NO_CONTEXT) {
         printf("[glshell] error: failed to create EGL context\n");
         exit(1);
     }
 
-    // print context info
-    printf("[glshell] EGL context client APIs: %s\n", eglQueryString(state->egl_display, EGL_CLIENT_APIS));
-
-    EGLint width, height;
-    eglQuerySurface(state->egl_display, state->wl_surface, EGL_WIDTH, &width);
-    eglQuerySurface(state->egl_display, state->wl_surface, EGL_HEIGHT, &height);
+    print_egl_info(display);
 
-    state->egl_surface = eglCreateWindowSurface(
-        state->egl_display,
-        egl_config,
-        (EGLNativeWindowType)state->wl_egl_surface,
-        0
+    if (has_egl_extension(display->egl_display, "EGL_KHR_swap_buffers_with_damage")) {
+        display->eglSwapBuffersWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC
+        )eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    } else if (has_egl_extension(display->egl_display, "EGL_EXT_swap_buffers_with_damage")) {
+        display->eglSwapBuffersWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC
+        )eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    }
+    display->buffer_age_supported =
+        has_egl_extension(display->egl_display, "EGL_EXT_buffer_age");
+    printf(
+        "[glshell] damage tracking: swap with damage %s, buffer age %s\n",
+        display->eglSwapBuffersWithDamage != NULL ? "yes" : "no",
+        display->buffer_age_supported ? "yes" : "no"
     );
 
-    if (state->egl_surface == EGL_NO_SURFACE) {
-        printf("[glshell] error: failed to create EGL surface\n");
-        EGLint egl_error = eglGetError();
-        char* egl_error_str = NULL;
-        switch (egl_error) {
-            case EGL_BAD_DISPLAY:
-                egl_error_str = "EGL_BAD_DISPLAY";
-                break;
-            case EGL_NOT_INITIALIZED:
-                egl_error_str = "EGL_NOT_INITIALIZED";
-                break;
-            case EGL_BAD_CONFIG:
-                egl_error_str = "EGL_BAD_CONFIG";
-                break;
-            case EGL_BAD_NATIVE_WINDOW:
-                egl_error_str = "EGL_BAD_NATIVE_WINDOW";
-                break;
-            case EGL_BAD_ATTRIBUTE:
-                egl_error_str = "EGL_BAD_ATTRIBUTE";
-                break;
-            case EGL_BAD_ALLOC:
-                egl_error_str = "EGL_BAD_ALLOC";
-                break;
-            case EGL_BAD_MATCH:
-                egl_error_str = "EGL_BAD_MATCH";
-                break;
-            case EGL_BAD_SURFACE:
-                egl_error_str = "EGL_BAD_SURFACE";
-                break;
-            case EGL_BAD_CURRENT_SURFACE:
-                egl_error_str = "EGL_BAD_CURRENT_SURFACE";
-                break;
-            case EGL_BAD_CONTEXT:
-                egl_error_str = "EGL_BAD_CONTEXT";
-                break;
-            case EGL_BAD_NATIVE_PIXMAP:
-                egl_error_str = "EGL_BAD_NATIVE_PIXMAP";
-                break;
-            case EGL_CONTEXT_LOST:
-                egl_error_str = "EGL_CONTEXT_LOST";
-                break;
-            default:
-                egl_error_str = "unknown";
+    display->initialized = true;
+    return display;
+}
+
+// one surface on the chosen output, or one on each. false if the output doesn't exist
+static bool instance_surfaces_create(struct glshell_state* state) {
+    struct glshell_display* display = state->display;
+    glshell_params_t* params = &state->params;
+    // a compositor may have none for a while, e.g. with every monitor unplugged
+    if (arrlenu(display->outputs) == 0) {
+        printf("[glshell] error: no outputs\n");
+        return false;
+    }
+    if (params->all_outputs) {
+        printf("[glshell] creating a surface on every output\n");
+        for (size_t i = 0; i < arrlenu(display->outputs); i++) {
+            surface_create(state, &display->outputs[i], true);
+        }
+    } else if (params->output_name != NULL) {
+        struct glshell_output_descriptor* output = NULL;
+        for (size_t i = 0; i < arrlenu(display->outputs); i++) {
+            if (strcmp(display->outputs[i].name, params->output_name) == 0) {
+                output = &display->outputs[i];
                 break;
+            }
         }
-        printf("[glshell] EGL error: %s\n", egl_error_str);
-        exit(1);
+
+        if (output == NULL) {
+            printf("[glshell] error: output %s not found\n", params->output_name);
+            return false;
+        }
+        surface_create(state, output, true);
+    } else {
+        printf("[glshell] output not specified\n");
+        printf("[glshell] using default output\n");
+        struct glshell_output_descriptor* output_descriptor = &display->outputs[0];
+        printf(
+            "[glshell] default output chosen: %s (%dx%d)\n",
+            output_descriptor->name,
+            output_descriptor->width,
+            output_descriptor->height
+        );
+        surface_create(state, output_descriptor, false);
     }
+    return true;
+}
 
-    if (!eglMakeCurrent(
-            state->egl_display,
-            state->egl_surface,
-            state->egl_surface,
-            state->egl_context
-        )) {
-        printf("[glshell] error: failed to make EGL context current\n");
-        exit(1);
+glshell_t* glshell_create(glshell_params_t* params) {
+    struct glshell_state* state = calloc(1, sizeof(struct glshell_state));
+    state->params = *params;
+    if (state->params.render_scale <= 0.0f) {
+        state->params.render_scale = 1.0f;
     }
+    state->continuous = true;
+    state->timer_fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &state->start_time);
+    state->last_time = state->start_time;
+
+    // every surface of every instance shares the one context and whatever the caller builds
+    // with it
+    struct glshell_display* display;
+    if (params->share != NULL) {
+        display = params->share->display;
+        if (display->headless != params->headless) {
+            printf("[glshell] error: headless instances can only share with each other\n");
+            exit(1);
+        }
+    } else {
+        display = display_create(params);
+    }
+    display->references++;
+    state->display = display;
+
+    bool created = true;
+    if (params->no_surfaces) {
+        if (!has_egl_extension(display->egl_display, "EGL_KHR_surfaceless_context")) {
+            printf("[glshell] error: no surfaceless context for an empty instance\n");
+            created = false;
+        }
+    } else if (display->headless) {
+        headless_surface_create(state);
+    } else {
+        if (display->wp_viewporter == NULL && state->params.render_scale != 1.0f) {
+            printf("[glshell] warning: render scale needs viewporter, ignoring it\n");
+        }
+        // the protocol thread must not dispatch events for surfaces still being set up
+        if (display->protocol_running) {
+            pthread_mutex_lock(&display->dispatch_lock);
+        }
+        created = instance_surfaces_create(state);
+        if (display->protocol_running) {
+            pthread_mutex_unlock(&display->dispatch_lock);
+        }
+    }
+    if (!created) {
+        free(state);
+        if (--display->references == 0) {
+            display_destroy(display);
+        }
+        return NULL;
+    }
+    arrput(display->instances, state);
 
-    printf("[glshell] EGL vendor: %s\n", eglQueryString(state->egl_display, EGL_VENDOR));
-    printf("[glshell] EGL version: %s\n", eglQueryString(state->egl_display, EGL_VERSION));
+    // leave the first surface current for the caller to set up GL
+    state->current = params->no_surfaces ? NULL : state->surfaces[0];
+    make_current(display, state->current);
 
-    eglSwapInterval(state->egl_display, 1);
+    if (params->share == NULL && params->render_thread && !display->headless) {
+        protocol_thread_start(display);
+    }
+    return state;
 }
 
-void glshell_cleanup(void) {
-    struct glshell_state* state = g_state;
+static void display_destroy(struct glshell_display* display) {
+    if (display->headless) {
+        headless_display_cleanup(display);
+        close(display->epoll_fd);
+        arrfree(display->instances);
+        free(display);
+        return;
+    }
+
+    if (display->reading) {
+        wl_display_cancel_read(display->wl_display);
+    }
+    // everything left is destroyed from this thread
+    if (display->protocol_running) {
+        protocol_thread_stop(display);
+    }
 
-    for (size_t i = 0; i < arrlenu(state->outputs); i++) {
-        struct glshell_output_descriptor* output_descriptor = &state->outputs[i];
+    for (size_t i = 0; i < arrlenu(display->outputs); i++) {
+        struct glshell_output_descriptor* output_descriptor = &display->outputs[i];
         free(output_descriptor->name);
+        wl_output_destroy(output_descriptor->wl_output);
     }
+    arrfree(display->outputs);
 
-    eglDestroySurface(state->egl_display, state->egl_surface);
-    eglDestroyContext(state->egl_display, state->egl_context);
-    eglTerminate(state->egl_display);
+    if (display->shared_context != EGL_NO_CONTEXT) {
+        eglDestroyContext(display->egl_display, display->shared_context);
+    }
+    eglDestroyContext(display->egl_display, display->egl_context);
+    eglTerminate(display->egl_display);
     eglReleaseThread();
 
-    zwlr_layer_surface_v1_destroy(state->zwlr_layer_surface_v1);
-    wl_surface_destroy(state->wl_surface);
-    zwlr_layer_shell_v1_destroy(state->zwlr_layer_shell_v1);
-    wl_compositor_destroy(state->wl_compositor);
-    wl_registry_destroy(state->wl_registry);
-    wl_display_disconnect(state->wl_display);
+    if (display->wp_viewporter != NULL) {
+        wp_viewporter_destroy(display->wp_viewporter);
+    }
+    if (display->wp_fractional_scale_manager_v1 != NULL) {
+        wp_fractional_scale_manager_v1_destroy(display->wp_fractional_scale_manager_v1);
+    }
+    zwlr_layer_shell_v1_destroy(display->zwlr_layer_shell_v1);
+    wl_compositor_destroy(display->wl_compositor);
+    wl_registry_destroy(display->wl_registry);
+    if (display->render_queue != NULL) {
+        wl_event_queue_destroy(display->render_queue);
+    }
+    wl_display_disconnect(display->wl_display);
 
+    close(display->epoll_fd);
+    arrfree(display->instances);
+    free(display);
+}
+
+void glshell_destroy(glshell_t* state) {
+    struct glshell_display* display = state->display;
+
+    if (state->timer_fd != -1) {
+        display_unwatch_fd(display, state->timer_fd);
+        close(state->timer_fd);
+    }
+
+    if (display->headless && !state->params.no_surfaces) {
+        headless_surface_destroy(state);
+    } else {
+        if (display->protocol_running) {
+            pthread_mutex_lock(&display->dispatch_lock);
+        }
+        while (arrlenu(state->surfaces) > 0) {
+            surface_destroy(state, state->surfaces[0]);
+        }
+        if (display->protocol_running) {
+            pthread_mutex_unlock(&display->dispatch_lock);
+        }
+        arrfree(state->surfaces);
+    }
+
+    for (size_t i = 0; i < arrlenu(display->instances); i++) {
+        if (display->instances[i] == state) {
+            arrdel(display->instances, i);
+            break;
+        }
+    }
     free(state);
+
+    if (--display->references == 0) {
+        display_destroy(display);
+    }
+}
+
+bool glshell_begin_frame(glshell_t* state) {
+    if (state->stop) {
+        return false;
+    }
+
+    // round robin, so that one fast output can't starve the others
+    size_t count = arrlenu(state->surfaces);
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (state->next_surface + i) % count;
+        struct glshell_surface* surface = state->surfaces[index];
+        if (surface->configured && surface->frame_ready) {
+            state->next_surface = index + 1;
+            state->current = surface;
+            make_current(state->display, surface);
+            if (state->display->headless) {
+                headless_bind_framebuffer(state);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool rect_empty(glshell_rect_t rect) {
+    return rect.width <= 0 || rect.height <= 0;
+}
+
+static glshell_rect_t rect_union(glshell_rect_t a, glshell_rect_t b) {
+    if (rect_empty(a)) {
+        return b;
+    }
+    if (rect_empty(b)) {
+        return a;
+    }
+    int x0 = a.x < b.x ? a.x : b.x;
+    int y0 = a.y < b.y ? a.y : b.y;
+    int x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int y1 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    return (glshell_rect_t){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static glshell_rect_t surface_rect(struct glshell_surface* surface) {
+    return (glshell_rect_t){ 0, 0, surface->width, surface->height };
+}
+
+// what changed this frame, in surface coordinates
+static glshell_rect_t frame_damage(struct glshell_surface* surface) {
+    if (surface->full_damage || rect_empty(surface->damage)) {
+        return surface_rect(surface);
+    }
+    return surface->damage;
+}
+
+// surface coordinates have a top left origin, GL and EGL use bottom left
+static glshell_rect_t flip_rect(struct glshell_surface* surface, glshell_rect_t rect) {
+    rect.y = (int)surface->height - rect.y - rect.height;
+    return rect;
+}
+
+void glshell_add_damage(glshell_t* state, int x, int y, int width, int height) {
+    struct glshell_surface* surface = state->current;
+    surface->damage = rect_union(surface->damage, (glshell_rect_t){ x, y, width, height });
+}
+
+glshell_rect_t glshell_get_repaint_region(glshell_t* state) {
+    struct glshell_display* display = state->display;
+    struct glshell_surface* surface = state->current;
+    if (!display->buffer_age_supported) {
+        return surface_rect(surface);
+    }
+
+    // the back buffer holds the frame from `age` swaps ago, so it misses this frame's damage
+    // and that of the age - 1 frames drawn since. age 0 means the contents are undefined
+    EGLint age = 0;
+    eglQuerySurface(display->egl_display, surface->egl_surface, EGL_BUFFER_AGE_EXT, &age);
+    if (age <= 0 || age - 1 > surface->damage_history_length) {
+        return surface_rect(surface);
+    }
+
+    glshell_rect_t region = frame_damage(surface);
+    for (int i = 0; i < age - 1; i++) {
+        region = rect_union(region, surface->damage_history[i]);
+    }
+    return flip_rect(surface, region);
+}
+
+void glshell_swap_buffers(glshell_t* state) {
+    struct glshell_display* display = state->display;
+    struct glshell_surface* surface = state->current;
+
+    if (display->headless) {
+        surface->frame_ready = false;
+        state->frames++;
+        headless_swap(state);
+        return;
+    }
+
+    // request the next frame callback before eglSwapBuffers commits the surface; the
+    // compositor holds it back while the surface is hidden or occluded, so we stop drawing.
+    // without continuous rendering only the next configure asks for another frame, and with
+    // an interval the timer asks for the callback on its next tick
+    if (state->continuous && state->timer_fd == -1) {
+        surface->frame_callback = wl_surface_frame(surface->frame_surface);
+        wl_callback_add_listener(surface->frame_callback, &frame_callback_listener, surface);
+    }
+    surface->frame_ready = false;
+    state->frames++;
+
+    glshell_rect_t damage = frame_damage(surface);
+    memmove(
+        &surface->damage_history[1],
+        &surface->damage_history[0],
+        (GLSHELL_DAMAGE_HISTORY - 1) * sizeof(glshell_rect_t)
+    );
+    surface->damage_history[0] = damage;
+    if (surface->damage_history_length < GLSHELL_DAMAGE_HISTORY) {
+        surface->damage_history_length++;
+    }
+    surface->damage = (glshell_rect_t){ 0, 0, 0, 0 };
+    surface->full_damage = false;
+
+    if (display->eglSwapBuffersWithDamage != NULL) {
+        glshell_rect_t rect = flip_rect(surface, damage);
+        EGLint rects[4] = { rect.x, rect.y, rect.width, rect.height };
+        display->eglSwapBuffersWithDamage(display->egl_display, surface->egl_surface, rects, 1);
+    } else {
+        eglSwapBuffers(display->egl_display, surface->egl_surface);
+    }
+
+    // this frame has the configured size and acks the configure
+    if (surface->configure_time.tv_sec != 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double latency = (now.tv_sec - surface->configure_time.tv_sec) * 1000.0 +
+                         (now.tv_nsec - surface->configure_time.tv_nsec) / 1000000.0;
+        state->configures++;
+        state->configure_latency_total += latency;
+        if (latency > state->configure_latency_max) {
+            state->configure_latency_max = latency;
+        }
+        surface->configure_time = (struct timespec){ 0, 0 };
+    }
+}
+
+void glshell_set_continuous(glshell_t* state, bool continuous) {
+    state->continuous = continuous;
+}
+
+void glshell_redraw(glshell_t* state) {
+    for (size_t i = 0; i < arrlenu(state->surfaces); i++) {
+        state->surfaces[i]->full_damage = true;
+        surface_schedule_redraw(state->surfaces[i]);
+    }
+}
+
+// the first expiry is the next multiple of the interval since the epoch, so a clock drawn
+// every second turns over with the wall clock rather than whenever glshell started
+static void arm_timer(struct glshell_state* state) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t next = ((now.tv_sec * 1000000000LL + now.tv_nsec) / state->interval + 1) *
+                   state->interval;
+    struct itimerspec spec = {
+        .it_interval = { state->interval / 1000000000LL, state->interval % 1000000000LL },
+        .it_value = { next / 1000000000LL, next % 1000000000LL },
+    };
+    timerfd_settime(
+        state->timer_fd,
+        TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+        &spec,
+        NULL
+    );
+}
+
+static void timer_expired(void* data) {
+    struct glshell_state* state = data;
+    uint64_t expirations;
+    if (read(state->timer_fd, &expirations, sizeof(expirations)) == -1) {
+        // the wall clock was set, line up with it again
+        if (errno == ECANCELED) {
+            arm_timer(state);
+        }
+        return;
+    }
+    // a tick asks for a frame callback rather than drawing, so that a hidden or occluded
+    // surface isn't drawn at all. ticks while one is pending, or missed while suspended or
+    // busy, still make a single frame
+    for (size_t i = 0; i < arrlenu(state->surfaces); i++) {
+        struct glshell_surface* surface = state->surfaces[i];
+        if (!surface->configured || surface->frame_ready || surface->frame_callback != NULL) {
+            continue;
+        }
+        surface->frame_callback = wl_surface_frame(surface->frame_surface);
+        wl_callback_add_listener(surface->frame_callback, &frame_callback_listener, surface);
+        wl_surface_commit(surface->frame_surface);
+    }
+}
+
+void glshell_set_interval(glshell_t* state, float ms) {
+    // headless frames are drawn back to back, there is nothing to pace
+    if (state->display->headless) {
+        return;
+    }
+    if (state->timer_fd != -1) {
+        printf("[glshell] error: the frame interval is already set\n");
+        exit(1);
+    }
+    // arm_timer() divides by the interval in nanoseconds, which must not truncate to 0
+    if (!(ms >= 1.0f)) {
+        printf("[glshell] error: the frame interval must be at least 1 ms, not %g\n", ms);
+        exit(1);
+    }
+    state->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (state->timer_fd == -1) {
+        printf("[glshell] error: unable to create a timer: %s\n", strerror(errno));
+        exit(1);
+    }
+    state->interval = ms * 1000000.0;
+    arm_timer(state);
+    display_watch_fd(state->display, state->timer_fd, timer_expired, state);
+}
+
+static void display_watch_fd(
+    struct glshell_display* display,
+    int fd,
+    glshell_fd_callback_t callback,
+    void* data
+) {
+    if (display->watch_count == GLSHELL_MAX_WATCHES) {
+        printf("[glshell] error: too many watched file descriptors\n");
+        exit(1);
+    }
+    display->watches[display->watch_count++] = (struct glshell_watch){ fd, callback, data };
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(display->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        printf("[glshell] error: unable to watch fd %d: %s\n", fd, strerror(errno));
+        exit(1);
+    }
+}
+
+static void display_unwatch_fd(struct glshell_display* display, int fd) {
+    for (int i = 0; i < display->watch_count; i++) {
+        if (display->watches[i].fd == fd) {
+            epoll_ctl(display->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            display->watches[i] = display->watches[--display->watch_count];
+            return;
+        }
+    }
+}
+
+void glshell_watch_fd(glshell_t* state, int fd, glshell_fd_callback_t callback, void* data) {
+    display_watch_fd(state->display, fd, callback, data);
+}
+
+void glshell_unwatch_fd(glshell_t* state, int fd) {
+    display_unwatch_fd(state->display, fd);
+}
+
+bool glshell_create_shared_context(glshell_t* state) {
+    struct glshell_display* display = state->display;
+    if (display->shared_context != EGL_NO_CONTEXT) {
+        return true;
+    }
+
+    // the other thread has no surface to make it current with
+    if (!has_egl_extension(display->egl_display, "EGL_KHR_surfaceless_context")) {
+        return false;
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION,
+        2,
+        EGL_NONE,
+    };
+    display->shared_context = eglCreateContext(
+        display->egl_display,
+        display->egl_config,
+        display->egl_context,
+        context_attribs
+    );
+    return display->shared_context != EGL_NO_CONTEXT;
+}
+
+bool glshell_make_shared_context_current(glshell_t* state) {
+    struct glshell_display* display = state->display;
+    return eglMakeCurrent(
+        display->egl_display,
+        EGL_NO_SURFACE,
+        EGL_NO_SURFACE,
+        display->shared_context
+    );
+}
+
+void glshell_release_shared_context(glshell_t* state) {
+    eglMakeCurrent(state->display->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+}
+
+// without a render thread everything is dispatched from the display's queue, with one only the
+// frame callbacks on the render queue
+static int prepare_read(struct glshell_display* display) {
+    if (display->render_queue != NULL) {
+        return wl_display_prepare_read_queue(display->wl_display, display->render_queue);
+    }
+    return wl_display_prepare_read(display->wl_display);
+}
+
+static int dispatch_queued(struct glshell_display* display) {
+    if (display->render_queue != NULL) {
+        return wl_display_dispatch_queue_pending(display->wl_display, display->render_queue);
+    }
+    return wl_display_dispatch_pending(display->wl_display);
 }
 
-void glshell_swap_buffers(void) {
-    struct glshell_state* state = g_state;
-    eglSwapBuffers(state->egl_display, state->egl_surface);
+int glshell_get_fd(glshell_t* state) {
+    return state->display->epoll_fd;
+}
+
+bool glshell_flush(glshell_t* state) {
+    struct glshell_display* display = state->display;
+    if (display->headless || display->reading) {
+        return true;
+    }
+
+    // events may already be queued, e.g. read by EGL while swapping. they have to be
+    // dispatched before reading more, or we could sleep with work left to do
+    while (prepare_read(display) != 0) {
+        if (dispatch_queued(display) == -1) {
+            return false;
+        }
+    }
+    display->reading = true;
+    // a full socket is flushed again before the next sleep
+    if (wl_display_flush(display->wl_display) == -1 && errno != EAGAIN) {
+        return false;
+    }
+    return true;
+}
+
+bool glshell_dispatch_pending(glshell_t* state) {
+    struct glshell_display* display = state->display;
+    display->wakeups++;
+
+    // whatever is ready now, without blocking: the caller already slept
+    struct epoll_event events[1 + GLSHELL_MAX_WATCHES];
+    int count = epoll_wait(display->epoll_fd, events, 1 + GLSHELL_MAX_WATCHES, 0);
+    int display_fd = display->headless ? -1 : wl_display_get_fd(display->wl_display);
+    bool display_readable = false;
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == display_fd) {
+            display_readable = true;
+        }
+    }
+
+    if (display->reading) {
+        display->reading = false;
+        if (display_readable) {
+            if (wl_display_read_events(display->wl_display) == -1) {
+                return false;
+            }
+        } else {
+            wl_display_cancel_read(display->wl_display);
+        }
+    }
+
+    // looked up by fd, a callback may unwatch another fd that was also ready
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < display->watch_count; j++) {
+            struct glshell_watch watch = display->watches[j];
+            if (watch.fd == events[i].data.fd) {
+                watch.callback(watch.data);
+                break;
+            }
+        }
+    }
+
+    // nothing to wait for without a compositor, every dispatch allows one more frame, whether
+    // rendering is continuous or not
+    if (display->headless) {
+        for (size_t i = 0; i < arrlenu(display->instances); i++) {
+            struct glshell_state* instance = display->instances[i];
+            if (arrlenu(instance->surfaces) > 0) {
+                instance->surfaces[0]->frame_ready = true;
+            }
+        }
+        return !state->stop;
+    }
+    return dispatch_queued(display) != -1 && !state->stop;
+}
+
+bool glshell_poll_events(glshell_t* state) {
+    if (!glshell_flush(state)) {
+        return false;
+    }
+    // without a compositor frames are drawn back to back, only watches may have work
+    struct pollfd pfd = { .fd = state->display->epoll_fd, .events = POLLIN };
+    poll(&pfd, 1, state->display->headless ? 0 : -1);
+    return glshell_dispatch_pending(state);
 }
 
-bool glshell_poll_events(void) {
-    struct glshell_state* state = g_state;
-    return wl_display_dispatch(state->wl_display) != -1 && !state->stop;
+void glshell_get_stats(glshell_t* state, glshell_stats_t* stats) {
+    stats->frames = state->frames;
+    stats->wakeups = state->display->wakeups;
+    stats->elapsed = glshell_get_time(state);
+    struct timespec cpu_time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+    stats->cpu_time = cpu_time.tv_sec + cpu_time.tv_nsec / 1000000000.0f;
+    stats->configures = state->configures;
+    stats->configure_latency_mean =
+        state->configures > 0 ? state->configure_latency_total / state->configures : 0.0f;
+    stats->configure_latency_max = state->configure_latency_max;
 }
 
-float glshell_get_delta_time(void) {
-    struct glshell_state* state = g_state;
+float glshell_get_delta_time(glshell_t* state) {
     clock_gettime(CLOCK_MONOTONIC, &state->current_time);
     float delta_time = (state->current_time.tv_sec - state->last_time.tv_sec) +
                        (state->current_time.tv_nsec - state->last_time.tv_nsec) / 1000000000.0f;
@@ -516,25 +2178,21 @@ float glshell_get_delta_time(void) {
     return delta_time;
 }
 
-float glshell_get_time(void) {
-    struct glshell_state* state = g_state;
+float glshell_get_time(glshell_t* state) {
     clock_gettime(CLOCK_MONOTONIC, &state->current_time);
     float time = (state->current_time.tv_sec - state->start_time.tv_sec) +
                  (state->current_time.tv_nsec - state->start_time.tv_nsec) / 1000000000.0f;
     return time;
 }
 
-float glshell_get_width(void) {
-    struct glshell_state* state = g_state;
-    return state->output_width;
+float glshell_get_width(glshell_t* state) {
+    return state->current != NULL ? state->current->width : 0.0f;
 }
 
-float glshell_get_height(void) {
-    struct glshell_state* state = g_state;
-    return state->output_height;
+float glshell_get_height(glshell_t* state) {
+    return state->current != NULL ? state->current->height : 0.0f;
 }
 
-void glshell_stop(void) {
-    struct glshell_state* state = g_state;
+void glshell_stop(glshell_t* state) {
     state->stop = true;
 }
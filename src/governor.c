@@ -0,0 +1,194 @@
+#include "governor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GOVERNOR_MIN_SCALE 0.25f
+// below this fraction of the budget there is room to render more pixels
+#define GOVERNOR_HEADROOM 0.7f
+// consecutive measurements needed before scaling down or up. going up is slow on purpose, so
+// the resolution doesn't bounce between two steps
+#define GOVERNOR_OVER_FRAMES 8
+#define GOVERNOR_UNDER_FRAMES 60
+#define GOVERNOR_SMOOTHING 0.1f
+
+void governor_init(governor_t* governor, float budget) {
+    memset(governor, 0, sizeof(*governor));
+    governor->budget = budget;
+    governor->scale = 1.0f;
+
+    glGenFramebuffers(1, &governor->framebuffer);
+    glGenTextures(1, &governor->texture);
+    glGenQueries(2 * GOVERNOR_QUERIES, &governor->queries[0][0]);
+}
+
+void governor_destroy(governor_t* governor) {
+    glDeleteQueries(2 * GOVERNOR_QUERIES, &governor->queries[0][0]);
+    glDeleteTextures(1, &governor->texture);
+    glDeleteFramebuffers(1, &governor->framebuffer);
+}
+
+static void governor_set_scale(governor_t* governor, float scale) {
+    if (scale < GOVERNOR_MIN_SCALE) {
+        scale = GOVERNOR_MIN_SCALE;
+    }
+    if (scale > 1.0f) {
+        scale = 1.0f;
+    }
+    if (scale == governor->scale) {
+        return;
+    }
+
+    printf(
+        "[glshell] render scale %.2f -> %.2f (gpu %.2f ms, budget %.2f ms)\n",
+        governor->scale,
+        scale,
+        governor->gpu_time,
+        governor->budget
+    );
+    governor->scale = scale;
+
+    // the queries still in flight measured the old scale
+    governor->settle = governor->query_count;
+    governor->samples = 0;
+    governor->over = 0;
+    governor->under = 0;
+}
+
+static void governor_sample(governor_t* governor, float gpu_time) {
+    if (governor->settle > 0) {
+        governor->settle--;
+        return;
+    }
+
+    if (governor->samples == 0) {
+        governor->gpu_time = gpu_time;
+    } else {
+        governor->gpu_time += (gpu_time - governor->gpu_time) * GOVERNOR_SMOOTHING;
+    }
+    governor->samples++;
+
+    if (governor->gpu_time > governor->budget) {
+        governor->over++;
+        governor->under = 0;
+    } else if (governor->gpu_time < governor->budget * GOVERNOR_HEADROOM) {
+        governor->under++;
+        governor->over = 0;
+    } else {
+        governor->over = 0;
+        governor->under = 0;
+    }
+
+    if (governor->over >= GOVERNOR_OVER_FRAMES) {
+        // GPU time follows the pixel count, which goes with the square of the scale. aim a bit
+        // under budget, and always take at least a small step
+        float target = governor->scale * sqrtf(governor->budget * 0.9f / governor->gpu_time);
+        if (target > governor->scale * 0.95f) {
+            target = governor->scale * 0.95f;
+        }
+        governor_set_scale(governor, target);
+    } else if (governor->under >= GOVERNOR_UNDER_FRAMES) {
+        governor_set_scale(governor, governor->scale * 1.1f);
+        governor->under = 0;
+    }
+}
+
+// reads whatever queries have finished, oldest first, without waiting on the rest
+static void governor_collect(governor_t* governor) {
+    while (governor->query_count > 0) {
+        GLuint* queries = governor->queries[governor->query_first];
+        GLint available = 0;
+        glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+
+        GLuint64 start, end;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+        governor->query_first = (governor->query_first + 1) % GOVERNOR_QUERIES;
+        governor->query_count--;
+
+        governor_sample(governor, (end - start) / 1000000.0f);
+    }
+}
+
+void governor_begin(governor_t* governor, int width, int height) {
+    governor_collect(governor);
+
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    governor->target = target;
+
+    if (width > governor->texture_width || height > governor->texture_height) {
+        governor->texture_width =
+            width > governor->texture_width ? width : governor->texture_width;
+        governor->texture_height =
+            height > governor->texture_height ? height : governor->texture_height;
+
+        glBindTexture(GL_TEXTURE_2D, governor->texture);
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            GL_RGBA8,
+            governor->texture_width,
+            governor->texture_height,
+            0,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            NULL
+        );
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, governor->framebuffer);
+        glFramebufferTexture2D(
+            GL_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D,
+            governor->texture,
+            0
+        );
+    }
+
+    governor->render_width = lroundf(width * governor->scale);
+    governor->render_height = lroundf(height * governor->scale);
+    governor->render_width = governor->render_width > 0 ? governor->render_width : 1;
+    governor->render_height = governor->render_height > 0 ? governor->render_height : 1;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, governor->framebuffer);
+
+    // with every query still pending this frame goes unmeasured rather than waiting
+    if (governor->query_count < GOVERNOR_QUERIES) {
+        int index = (governor->query_first + governor->query_count) % GOVERNOR_QUERIES;
+        glQueryCounter(governor->queries[index][0], GL_TIMESTAMP);
+        governor->query_active = true;
+    }
+}
+
+void governor_end(governor_t* governor, int width, int height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, governor->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, governor->target);
+    bool scaled = governor->render_width != width || governor->render_height != height;
+    glBlitFramebuffer(
+        0,
+        0,
+        governor->render_width,
+        governor->render_height,
+        0,
+        0,
+        width,
+        height,
+        GL_COLOR_BUFFER_BIT,
+        scaled ? GL_LINEAR : GL_NEAREST
+    );
+    glBindFramebuffer(GL_FRAMEBUFFER, governor->target);
+
+    // the upscale is part of what the budget pays for
+    if (governor->query_active) {
+        int index = (governor->query_first + governor->query_count) % GOVERNOR_QUERIES;
+        glQueryCounter(governor->queries[index][1], GL_TIMESTAMP);
+        governor->query_count++;
+        governor->query_active = false;
+    }
+}
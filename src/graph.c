@@ -0,0 +1,430 @@
+#include "graph.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shader.h"
+#include "stb_ds.h"
+
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(size + 1);
+    size_t length = fread(data, 1, size, file);
+    data[length] = '\0';
+    fclose(file);
+    return data;
+}
+
+static void parse_option(graph_pass_t* pass, const char* spec, const char* option) {
+    if (strncmp(option, "scale=", 6) == 0) {
+        pass->scale = atof(option + 6);
+        if (pass->scale > 0.0f) {
+            return;
+        }
+    } else if (strncmp(option, "rate=", 5) == 0) {
+        pass->rate = atof(option + 5);
+        if (pass->rate > 0.0f) {
+            return;
+        }
+    } else if (strcmp(option, "format=rgba8") == 0) {
+        pass->format = GL_RGBA8;
+        return;
+    } else if (strcmp(option, "format=rgba16f") == 0) {
+        pass->format = GL_RGBA16F;
+        return;
+    } else if (strcmp(option, "format=rgba32f") == 0) {
+        pass->format = GL_RGBA32F;
+        return;
+    } else if (strcmp(option, "filter=linear") == 0) {
+        pass->filter = GL_LINEAR;
+        return;
+    } else if (strcmp(option, "filter=nearest") == 0) {
+        pass->filter = GL_NEAREST;
+        return;
+    } else if (strcmp(option, "wrap=clamp") == 0) {
+        pass->wrap = GL_CLAMP_TO_EDGE;
+        return;
+    } else if (strcmp(option, "wrap=repeat") == 0) {
+        pass->wrap = GL_REPEAT;
+        return;
+    }
+
+    printf("[glshell] error: invalid option %s in pass %s\n", option, spec);
+    exit(1);
+}
+
+void graph_add_pass(graph_t* graph, const char* spec, const char* vertex_shader) {
+    graph_pass_t pass = {
+        .scale = 1.0f,
+        .format = GL_RGBA8,
+        .filter = GL_LINEAR,
+        .wrap = GL_CLAMP_TO_EDGE,
+        .u_time = -1,
+        .u_resolution = -1,
+    };
+
+    const char* equals = strchr(spec, '=');
+    if (equals == NULL || equals == spec) {
+        printf("[glshell] error: pass %s is not <name>=<path>\n", spec);
+        exit(1);
+    }
+    pass.name = strndup(spec, equals - spec);
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        if (strcmp(graph->passes[i].name, pass.name) == 0) {
+            printf("[glshell] error: pass %s is defined twice\n", pass.name);
+            exit(1);
+        }
+    }
+
+    char* options = strdup(equals + 1);
+    char* saveptr;
+    pass.path = strdup(strtok_r(options, ",", &saveptr));
+    for (char* option = strtok_r(NULL, ",", &saveptr); option != NULL;
+         option = strtok_r(NULL, ",", &saveptr)) {
+        parse_option(&pass, spec, option);
+    }
+    free(options);
+
+    pass.source = read_file(pass.path);
+    if (pass.source == NULL) {
+        printf("[glshell] error: unable to open %s\n", pass.path);
+        exit(1);
+    }
+    pass.program = shader_program_load(vertex_shader, pass.source, NULL);
+    if (pass.program == 0) {
+        printf("[glshell] error: unable to build pass %s\n", pass.name);
+        exit(1);
+    }
+    pass.u_time = glGetUniformLocation(pass.program, "u_time");
+    pass.u_resolution = glGetUniformLocation(pass.program, "u_resolution");
+
+    arrput(graph->passes, pass);
+}
+
+static int find_pass(graph_t* graph, const char* name) {
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        if (strcmp(graph->passes[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// assigns a texture unit to each pass a program samples, and finds out if it reads u_time
+static bool link_inputs(
+    graph_t* graph,
+    GLuint program,
+    graph_input_t** inputs,
+    graph_alpha_t** alphas
+) {
+    arrsetlen(*inputs, 0);
+    arrsetlen(*alphas, 0);
+    bool uses_time = false;
+    if (program == 0) {
+        return false;
+    }
+
+    GLint uniform_count;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glUseProgram(program);
+
+    // uniforms optimized out by the compiler are not active, so this is what the shader reads
+    for (GLint i = 0; i < uniform_count; i++) {
+        char name[64];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, i, sizeof(name), NULL, &size, &type, name);
+        if (strcmp(name, "u_time") == 0) {
+            uses_time = true;
+        }
+        if (type == GL_FLOAT && strncmp(name, "u_alpha_", 8) == 0) {
+            graph_alpha_t alpha = {
+                .location = glGetUniformLocation(program, name),
+                .pass = find_pass(graph, name + 8),
+            };
+            if (alpha.pass == -1) {
+                printf("[glshell] warning: %s does not name a pass\n", name);
+            } else {
+                arrput(*alphas, alpha);
+            }
+            continue;
+        }
+        bool previous = strncmp(name, "u_prev_", 7) == 0;
+        if (type != GL_SAMPLER_2D || (!previous && strncmp(name, "u_pass_", 7) != 0)) {
+            continue;
+        }
+
+        graph_input_t input = {.pass = find_pass(graph, name + 7), .previous = previous};
+        if (input.pass == -1) {
+            printf("[glshell] warning: %s does not name a pass\n", name);
+        }
+        glUniform1i(glGetUniformLocation(program, name), arrlen(*inputs));
+        arrput(*inputs, input);
+    }
+
+    return uses_time;
+}
+
+void graph_use_program(graph_t* graph, GLuint program) {
+    // passes can sample passes after them, so they are only linked once all are known
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        graph_pass_t* pass = &graph->passes[i];
+        pass->uses_time = link_inputs(graph, pass->program, &pass->inputs, &pass->alphas);
+    }
+
+    graph->output_program = program;
+    link_inputs(graph, program, &graph->output_inputs, &graph->output_alphas);
+}
+
+bool graph_animated(graph_t* graph) {
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        graph_pass_t* pass = &graph->passes[i];
+        if (pass->uses_time || pass->rate > 0.0f) {
+            return true;
+        }
+        for (int j = 0; j < arrlen(pass->inputs); j++) {
+            if (pass->inputs[j].previous || pass->inputs[j].pass == i) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void graph_invalidate_channels(graph_t* graph, uint32_t channels) {
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        if (graph->passes[i].channels & channels) {
+            graph->passes[i].stale = true;
+        }
+    }
+}
+
+void graph_invalidate_feed(graph_t* graph) {
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        if (graph->passes[i].feed) {
+            graph->passes[i].stale = true;
+        }
+    }
+}
+
+static void bind_inputs(graph_t* graph, graph_input_t* inputs, graph_alpha_t* alphas) {
+    for (int i = 0; i < arrlen(alphas); i++) {
+        glUniform1f(alphas[i].location, graph->passes[alphas[i].pass].alpha);
+    }
+
+    for (int i = 0; i < arrlen(inputs); i++) {
+        if (inputs[i].pass == -1) {
+            continue;
+        }
+        graph_pass_t* pass = &graph->passes[inputs[i].pass];
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(
+            GL_TEXTURE_2D,
+            pass->textures[inputs[i].previous ? pass->previous : pass->current]
+        );
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+static void resize_pass(graph_pass_t* pass, int width, int height) {
+    if (pass->textures[0] == 0) {
+        glGenTextures(2, pass->textures);
+        glGenFramebuffers(2, pass->framebuffers);
+    }
+    pass->width = width;
+    pass->height = height;
+
+    bool floating = pass->format != GL_RGBA8;
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, pass->textures[i]);
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            pass->format,
+            width,
+            height,
+            0,
+            GL_RGBA,
+            floating ? GL_FLOAT : GL_UNSIGNED_BYTE,
+            NULL
+        );
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pass->filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pass->filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, pass->wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, pass->wrap);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pass->framebuffers[i]);
+        glFramebufferTexture2D(
+            GL_DRAW_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D,
+            pass->textures[i],
+            0
+        );
+        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("[glshell] error: pass %s can't render to its texture format\n", pass->name);
+            exit(1);
+        }
+        // feedback starts from nothing
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// a pass is drawn again only if something it reads may have changed since it last was
+static bool pass_dirty(graph_t* graph, int index) {
+    graph_pass_t* pass = &graph->passes[index];
+    if (pass->drawn == 0 || pass->uses_time || pass->stale) {
+        return true;
+    }
+    for (int i = 0; i < arrlen(pass->inputs); i++) {
+        graph_input_t* input = &pass->inputs[i];
+        if (input->pass == -1) {
+            continue;
+        }
+        // feedback, a pass reading itself sees the frame before
+        if (input->previous || input->pass == index) {
+            return true;
+        }
+        // a pass drawn later in the same frame wasn't seen yet either
+        uint64_t drawn = graph->passes[input->pass].drawn;
+        if (drawn > pass->drawn || (input->pass > index && drawn == pass->drawn)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// how many fixed rate steps are due at `time`, dropping the ones beyond GRAPH_MAX_STEPS so a
+// slow frame doesn't make the next ones slower still
+static int pass_steps(graph_pass_t* pass, float time) {
+    float step = 1.0f / pass->rate;
+    if (pass->drawn == 0 || time < pass->step_time) {
+        pass->step_time = time;
+        pass->alpha = 0.0f;
+        return 1;
+    }
+
+    // a step that is due exactly shouldn't be lost to rounding
+    int steps = (time - pass->step_time) / step + 0.001f;
+    if (steps > GRAPH_MAX_STEPS) {
+        pass->step_time += (steps - GRAPH_MAX_STEPS) * step;
+        steps = GRAPH_MAX_STEPS;
+    }
+    pass->step_time += steps * step;
+    pass->alpha = fmaxf((time - pass->step_time) / step, 0.0f);
+    return steps;
+}
+
+void graph_render(graph_t* graph, float time, int width, int height) {
+    graph->frame++;
+    // until a pass is drawn again, its latest output is also the one of the frame before. for
+    // fixed rate passes it is the one of the step before
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        if (graph->passes[i].rate == 0.0f) {
+            graph->passes[i].previous = graph->passes[i].current;
+        }
+    }
+
+    bool drawing = false;
+    GLint target = 0;
+    bool blend = false;
+    bool scissor = false;
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        graph_pass_t* pass = &graph->passes[i];
+        int pass_width = width * pass->scale + 0.5f;
+        int pass_height = height * pass->scale + 0.5f;
+        pass_width = pass_width > 0 ? pass_width : 1;
+        pass_height = pass_height > 0 ? pass_height : 1;
+        bool resized = pass->width != pass_width || pass->height != pass_height;
+        if (resized) {
+            pass->drawn = 0;
+        }
+
+        int steps;
+        if (pass->rate > 0.0f) {
+            steps = pass_steps(pass, time);
+        } else {
+            steps = pass_dirty(graph, i) ? 1 : 0;
+        }
+        if (steps == 0) {
+            continue;
+        }
+
+        // passes always cover their whole texture, and write rather than blend
+        if (!drawing) {
+            drawing = true;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+            blend = glIsEnabled(GL_BLEND);
+            scissor = glIsEnabled(GL_SCISSOR_TEST);
+            glDisable(GL_BLEND);
+            glDisable(GL_SCISSOR_TEST);
+        }
+        if (resized) {
+            resize_pass(pass, pass_width, pass_height);
+        }
+
+        glViewport(0, 0, pass->width, pass->height);
+        glUseProgram(pass->program);
+        if (pass->u_resolution != -1) {
+            glUniform2f(pass->u_resolution, pass->width, pass->height);
+        }
+        for (int step = 0; step < steps; step++) {
+            // fixed rate passes see the time of each step
+            if (pass->u_time != -1 && pass->rate > 0.0f) {
+                glUniform1f(pass->u_time, pass->step_time - (steps - 1 - step) / pass->rate);
+            } else if (pass->u_time != -1) {
+                glUniform1f(pass->u_time, time);
+            }
+            int next = 1 - pass->current;
+            bind_inputs(graph, pass->inputs, pass->alphas);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pass->framebuffers[next]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            pass->previous = pass->current;
+            pass->current = next;
+        }
+        pass->drawn = graph->frame;
+        pass->stale = false;
+    }
+
+    if (drawing) {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glViewport(0, 0, width, height);
+        glUseProgram(graph->output_program);
+        if (blend) {
+            glEnable(GL_BLEND);
+        }
+        if (scissor) {
+            glEnable(GL_SCISSOR_TEST);
+        }
+    }
+    bind_inputs(graph, graph->output_inputs, graph->output_alphas);
+}
+
+void graph_destroy(graph_t* graph) {
+    for (int i = 0; i < arrlen(graph->passes); i++) {
+        graph_pass_t* pass = &graph->passes[i];
+        glDeleteProgram(pass->program);
+        if (pass->textures[0] != 0) {
+            glDeleteFramebuffers(2, pass->framebuffers);
+            glDeleteTextures(2, pass->textures);
+        }
+        arrfree(pass->inputs);
+        arrfree(pass->alphas);
+        free(pass->name);
+        free(pass->path);
+        free(pass->source);
+    }
+    arrfree(graph->passes);
+    arrfree(graph->output_inputs);
+    arrfree(graph->output_alphas);
+}
@@ -0,0 +1,40 @@
+#include "image.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#include "stb_image.h"
+
+unsigned char* image_load(const char* path, int* width, int* height, const char** error) {
+    int components;
+    unsigned char* pixels = stbi_load(path, width, height, &components, 4);
+    if (pixels == NULL) {
+        *error = stbi_failure_reason();
+    }
+    return pixels;
+}
+
+unsigned char* image_load_from_memory(
+    const unsigned char* data,
+    size_t size,
+    int* width,
+    int* height,
+    const char** error
+) {
+    int components;
+    unsigned char* pixels = stbi_load_from_memory(data, size, width, height, &components, 4);
+    if (pixels == NULL) {
+        *error = stbi_failure_reason();
+    }
+    return pixels;
+}
+
+bool image_info(const char* path, int* width, int* height) {
+    int components;
+    return stbi_info(path, width, height, &components);
+}
+
+void image_free(unsigned char* pixels) {
+    stbi_image_free(pixels);
+}
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include "ipc.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "stb_ds.h"
+
+// clients and the socket readable at once, more wake glshell again
+#define IPC_EVENTS 16
+
+void ipc_reply(ipc_client_t* client, const char* format, ...) {
+    char line[IPC_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if (length > (int)sizeof(line) - 2) {
+        length = sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+
+    // replies are short and clients wait for them, a client that doesn't read loses them.
+    // MSG_NOSIGNAL, as one that hung up must not take the daemon with it
+    for (int sent = 0; sent < length;) {
+        ssize_t count = send(client->fd, line + sent, length - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return;
+        }
+        sent += count;
+    }
+}
+
+// words are separated by spaces or tabs, a word in double quotes may contain them
+static int split(char* line, char** argv) {
+    int argc = 0;
+    char* p = line;
+    while (argc < IPC_ARGS_MAX) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (*p == '"') {
+            argv[argc++] = ++p;
+            while (*p != '\0' && *p != '"') {
+                p++;
+            }
+        } else {
+            argv[argc++] = p;
+            while (*p != '\0' && *p != ' ' && *p != '\t') {
+                p++;
+            }
+        }
+        if (*p == '\0') {
+            break;
+        }
+        *p++ = '\0';
+    }
+    return argc;
+}
+
+static void client_destroy(ipc_server_t* server, ipc_client_t* client) {
+    for (size_t i = 0; i < arrlenu(server->clients); i++) {
+        if (server->clients[i] == client) {
+            arrdelswap(server->clients, i);
+            break;
+        }
+    }
+    epoll_ctl(server->epoll, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    arrfree(client->buffer);
+    free(client);
+}
+
+// runs every complete line received, and lets the client go once it hung up
+static void client_readable(ipc_server_t* server, ipc_client_t* client) {
+    char buffer[IPC_LINE_MAX];
+    ssize_t length;
+    while ((length = read(client->fd, buffer, sizeof(buffer))) > 0) {
+        memcpy(arraddnptr(client->buffer, length), buffer, length);
+    }
+    bool closed = length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+
+    size_t start = 0;
+    for (size_t i = 0; i < arrlenu(client->buffer); i++) {
+        if (client->buffer[i] != '\n') {
+            continue;
+        }
+        client->buffer[i] = '\0';
+        char* line = client->buffer + start;
+        start = i + 1;
+        size_t end = strlen(line);
+        if (end > 0 && line[end - 1] == '\r') {
+            line[end - 1] = '\0';
+        }
+
+        char* argv[IPC_ARGS_MAX];
+        int argc = split(line, argv);
+        if (argc > 0) {
+            server->command(server->data, client, argc, argv);
+        }
+    }
+    if (start > 0) {
+        arrdeln(client->buffer, 0, start);
+    }
+
+    if (arrlenu(client->buffer) >= IPC_LINE_MAX) {
+        ipc_reply(client, "error line too long");
+        closed = true;
+    }
+    if (closed) {
+        client_destroy(server, client);
+    }
+}
+
+static void server_accept(ipc_server_t* server) {
+    int fd;
+    while ((fd = accept4(server->socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        ipc_client_t* client = calloc(1, sizeof(ipc_client_t));
+        client->fd = fd;
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+        if (epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        arrput(server->clients, client);
+    }
+}
+
+// from glshell_dispatch_pending(), whenever the socket or a client is readable
+static void server_ready(void* data) {
+    ipc_server_t* server = data;
+    struct epoll_event events[IPC_EVENTS];
+    int count = epoll_wait(server->epoll, events, IPC_EVENTS, 0);
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.ptr == NULL) {
+            server_accept(server);
+        } else {
+            client_readable(server, events[i].data.ptr);
+        }
+    }
+}
+
+// a socket file left behind by a daemon that crashed refuses connections, one that is still
+// running accepts them
+static bool socket_in_use(const struct sockaddr_un* address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool in_use = connect(fd, (const struct sockaddr*)address, sizeof(*address)) == 0;
+    close(fd);
+    return in_use;
+}
+
+ipc_server_t* ipc_server_create(glshell_t* glshell, ipc_command_fn command, void* data) {
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir == NULL) {
+        printf("[glshell] error: --daemon needs XDG_RUNTIME_DIR to be set\n");
+        exit(1);
+    }
+
+    ipc_server_t* server = calloc(1, sizeof(ipc_server_t));
+    server->glshell = glshell;
+    server->command = command;
+    server->data = data;
+    server->path = malloc(strlen(runtime_dir) + sizeof("/glshell.sock"));
+    sprintf(server->path, "%s/glshell.sock", runtime_dir);
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(server->path) >= sizeof(address.sun_path)) {
+        printf("[glshell] error: socket path %s is too long\n", server->path);
+        exit(1);
+    }
+    strcpy(address.sun_path, server->path);
+    if (socket_in_use(&address)) {
+        printf("[glshell] error: a daemon is already listening on %s\n", server->path);
+        exit(1);
+    }
+    unlink(server->path);
+
+    server->socket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->socket == -1 ||
+        bind(server->socket, (struct sockaddr*)&address, sizeof(address)) == -1 ||
+        listen(server->socket, 16) == -1) {
+        printf("[glshell] error: unable to listen on %s: %s\n", server->path, strerror(errno));
+        exit(1);
+    }
+
+    server->epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    if (server->epoll == -1 ||
+        epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->socket, &event) == -1) {
+        printf("[glshell] error: unable to watch %s: %s\n", server->path, strerror(errno));
+        exit(1);
+    }
+    glshell_watch_fd(glshell, server->epoll, server_ready, server);
+
+    printf("[glshell] listening on %s\n", server->path);
+    return server;
+}
+
+void ipc_server_destroy(ipc_server_t* server) {
+    while (arrlenu(server->clients) > 0) {
+        client_destroy(server, server->clients[0]);
+    }
+    arrfree(server->clients);
+    glshell_unwatch_fd(server->glshell, server->epoll);
+    close(server->epoll);
+    close(server->socket);
+    unlink(server->path);
+    free(server->path);
+    free(server);
+}
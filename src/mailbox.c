@@ -0,0 +1,67 @@
+#include "mailbox.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+void mailbox_init(mailbox_t* mailbox, size_t item_size, size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    mailbox->items = malloc(rounded * item_size);
+    mailbox->item_size = item_size;
+    mailbox->capacity = rounded;
+    atomic_init(&mailbox->head, 0);
+    atomic_init(&mailbox->tail, 0);
+    mailbox->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mailbox->event == -1) {
+        printf("[glshell] error: unable to create a mailbox eventfd\n");
+        exit(1);
+    }
+}
+
+bool mailbox_push(mailbox_t* mailbox, const void* item) {
+    size_t tail = atomic_load_explicit(&mailbox->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&mailbox->head, memory_order_acquire);
+    if (tail - head == mailbox->capacity) {
+        return false;
+    }
+    size_t index = tail & (mailbox->capacity - 1);
+    memcpy(mailbox->items + index * mailbox->item_size, item, mailbox->item_size);
+    // the item is written before the consumer can see the new tail
+    atomic_store_explicit(&mailbox->tail, tail + 1, memory_order_release);
+
+    // every push wakes the consumer. skipping it while the ring isn't empty would race with a
+    // consumer that just emptied it and is about to sleep
+    uint64_t one = 1;
+    write(mailbox->event, &one, sizeof(one));
+    return true;
+}
+
+bool mailbox_pop(mailbox_t* mailbox, void* item) {
+    size_t head = atomic_load_explicit(&mailbox->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&mailbox->tail, memory_order_acquire);
+    if (head == tail) {
+        // clear the event before looking again, so a push in between still leaves it set
+        uint64_t count;
+        read(mailbox->event, &count, sizeof(count));
+        tail = atomic_load_explicit(&mailbox->tail, memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+    }
+    size_t index = head & (mailbox->capacity - 1);
+    memcpy(item, mailbox->items + index * mailbox->item_size, mailbox->item_size);
+    // the slot is read before the producer can reuse it
+    atomic_store_explicit(&mailbox->head, head + 1, memory_order_release);
+    return true;
+}
+
+void mailbox_destroy(mailbox_t* mailbox) {
+    close(mailbox->event);
+    free(mailbox->items);
+}
@@ -1,12 +1,16 @@
 #include <wayland-egl-core.h>
 #define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -16,233 +20,1259 @@
 #include "stb_ds.h"
 
 #include "args.h"
+#include "bake.h"
+#include "channel.h"
+#include "export.h"
+#include "feed.h"
 #include "glshell.h"
+#include "governor.h"
+#include "graph.h"
+#include "ipc.h"
+#include "reload.h"
+#include "shader.h"
+#include "stats.h"
 
-void init_gl(const char* fragment_shader);
-void shutdown_gl(void);
-void draw_frame(void);
+typedef struct gl_context {
+    // the instance frames are drawn with
+    glshell_t* glshell;
 
-// signal handler
-static void signal_cleanup(int sig) {
-    printf("[glshell] received signal %d\n", sig);
+    GLuint program;
+    GLuint vao;
+
+    // uniform locations, -1 if the shader doesn't use them
+    GLint u_time;
+    GLint u_resolution;
+    GLint u_render_scale;
+
+    // last uploaded values, to skip redundant updates
+    float resolution[2];
+    float render_scale;
+    glshell_rect_t scissor;
+
+    // every pixel is overwritten without blending, no need to clear
+    bool opaque;
+
+    // set with --frame-budget, renders offscreen at a resolution the GPU keeps up with
+    governor_t* governor;
+
+    // set with --pass, drawn into textures before the program each frame
+    graph_t* graph;
+
+    // set with --channel, images any program can sample
+    channels_t* channels;
 
-    if (sig == SIGINT || sig == SIGTERM) {
+    // set with --feed, values from other processes for any program declaring the block.
+    // static shaders are redrawn when a writer wakes feed->wakeup, if feed_wakes
+    feed_t* feed;
+    bool feed_linked;
+    bool feed_wakes;
+
+    // set with --bake-loop, baked at the size of the first frame drawn and again after a
+    // reload
+    char* bake_shader;
+    float bake_period;
+    int bake_frames;
+    size_t bake_max_bytes;
+    bool baked;
+    bake_t bake;
+} gl_context_t;
+
+bool init_gl(
+    gl_context_t* context,
+    const char* fragment_shader,
+    bool opaque,
+    float frame_budget,
+    shader_load_info_t* program_info
+);
+channels_t* init_channels(gl_context_t* context, char** specs);
+void init_graph(gl_context_t* context, char** passes);
+void init_feed(gl_context_t* context, const char* name, bool wake);
+void watch_feed(gl_context_t* context, bool animated);
+void init_bake(
+    gl_context_t* context,
+    const char* fragment_shader,
+    float period,
+    int frames,
+    float max_mb
+);
+void use_program(gl_context_t* context, GLuint program);
+void reload_program(void* data, GLuint program, char* fragment_shader);
+bool program_uses_time(gl_context_t* context);
+void shutdown_gl(gl_context_t* context);
+void draw_shader(void* data, float time, int width, int height);
+void draw_frame(gl_context_t* context, float time);
+void bind_gl(gl_context_t* context);
+extern const char* c_vertex_shader;
+
+static void write_json_string(FILE* file, const char* string) {
+    fputc('"', file);
+    for (const char* c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// one JSON object per run, for the benchmark suite to compare across versions
+static void write_json(
+    const char* path,
+    args_t* args,
+    shader_load_info_t* program_info,
+    frame_stats_t* frame_stats,
+    glshell_t* glshell,
+    glshell_stats_t* stats,
+    channels_t* channels,
+    int frame_count,
+    float seconds,
+    float first_frame_ms
+) {
+    FILE* file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == NULL) {
+        printf("[glshell] error: unable to open %s\n", path);
+        return;
+    }
+
+    fprintf(file, "{\"shader\": ");
+    write_json_string(file, args->fragment_shader);
+    fprintf(
+        file,
+        ", \"width\": %.0f, \"height\": %.0f, \"headless\": %s, \"frame_budget_ms\": %.4f, "
+        "\"frames\": %d, \"seconds\": %.4f, \"fps\": %.4f, \"first_frame_ms\": %.4f, "
+        "\"program_load_ms\": %.4f, \"compile_ms\": %.4f, \"program_cached\": %s, "
+        "\"wakeups_per_hour\": %.1f, \"cpu_seconds_per_hour\": %.4f, ",
+        glshell_get_width(glshell),
+        glshell_get_height(glshell),
+        args->headless ? "true" : "false",
+        args->frame_budget,
+        frame_count,
+        seconds,
+        frame_count / seconds,
+        first_frame_ms,
+        program_info->load_ms,
+        program_info->compile_ms,
+        program_info->cached ? "true" : "false",
+        stats->wakeups / stats->elapsed * 3600.0f,
+        stats->cpu_time / stats->elapsed * 3600.0f
+    );
+    frame_stats_write_json(frame_stats, file);
+    if (channels != NULL) {
+        fprintf(file, ", ");
+        channels_write_json(channels, file);
+    }
+    fprintf(file, "}\n");
+
+    if (file != stdout) {
+        fclose(file);
+    }
+}
+
+// SIGINT and SIGTERM are read from a signalfd in the main loop rather than handled
+// asynchronously. they are blocked before any thread starts, so every thread inherits the mask
+static int init_signals(void) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) == -1) {
+        printf("[glshell] error: unable to block signals\n");
+        exit(1);
+    }
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        printf("[glshell] error: unable to create a signalfd\n");
+        exit(1);
+    }
+    return signal_fd;
+}
+
+static void handle_signals(int signal_fd, glshell_t* glshell) {
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        printf("[glshell] received signal %" PRIu32 "\n", info.ssi_signo);
         printf("[glshell] stopping\n");
-        glshell_stop();
+        glshell_stop(glshell);
     }
 }
 
-int main(int argc, char* argv[]) {
-    args_t args = args_parse(argc, argv);
+static glshell_params_t params_from_args(args_t* args) {
     glshell_params_t params = {
-        .width = args.width,
-        .height = args.height,
-        .margin = args.margin,
-        .anchor = args.anchor,
-        .reserve = args.reserve,
-        .layer = args.layer,
-        .output_name = args.output_name,
+        .width = args->width,
+        .height = args->height,
+        .margin = args->margin,
+        .anchor = args->anchor,
+        .reserve = args->reserve,
+        .layer = args->layer,
+        .output_name = args->output_name,
+        .all_outputs = args->all_outputs,
+        .opaque = args->opaque,
+        .render_scale = args->render_scale,
+        .headless = args->headless,
+        .render_thread = args->render_thread,
     };
+    return params;
+}
 
-    glshell_init(&params);
+// NULL if the file can't be opened
+static char* read_shader(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = malloc(size + 1);
+    size_t length = fread(source, 1, size, file);
+    fclose(file);
+    source[length] = '\0';
+    return source;
+}
 
-    // register signal handler
-    if (signal(SIGINT, signal_cleanup) == SIG_ERR) {
-        printf("[glshell] error: unable to register signal handler\n");
+static void init_glew(void) {
+    // GLEW built for GLX reports a missing X display after loading everything it needs
+    GLenum glew_error = glewInit();
+    if (glew_error != GLEW_OK && glew_error != GLEW_ERROR_NO_GLX_DISPLAY) {
+        printf("[glshell] error: unable to initialize GLEW\n");
         exit(1);
     }
+}
+
+static int run_daemon(args_t* args, int signal_fd);
+
+int main(int argc, char* argv[]) {
+    args_t args = args_parse(argc, argv);
+    int signal_fd = init_signals();
+    if (args.daemon) {
+        int status = run_daemon(&args, signal_fd);
+        close(signal_fd);
+        return status;
+    }
+    glshell_params_t params = params_from_args(&args);
+
+    // images decode while the compositor connection is set up
+    gl_context_t context = { 0 };
+    channels_t* channels = NULL;
+    if (arrlen(args.channels) > 0) {
+        channels = init_channels(&context, args.channels);
+    }
 
-    if (signal(SIGTERM, signal_cleanup) == SIG_ERR) {
-        printf("[glshell] error: unable to register signal handler\n");
+    if (args.render_thread && args.headless) {
+        printf("[glshell] warning: --render-thread has no effect with --headless\n");
+    }
+    glshell_t* glshell = glshell_create(&params);
+    if (glshell == NULL) {
         exit(1);
     }
+    context.glshell = glshell;
 
     // load fragment shader
-    FILE* fragment_shader_file = fopen(args.fragment_shader, "r");
-    if (fragment_shader_file == NULL) {
+    char* fragment_shader = read_shader(args.fragment_shader);
+    if (fragment_shader == NULL) {
         printf("[glshell] error: unable to open fragment shader file\n");
         exit(1);
     }
-    fseek(fragment_shader_file, 0, SEEK_END);
-    size_t fragment_shader_size = ftell(fragment_shader_file);
-    fseek(fragment_shader_file, 0, SEEK_SET);
-    char* fragment_shader = malloc(fragment_shader_size + 1);
-    fread(fragment_shader, 1, fragment_shader_size, fragment_shader_file);
-    fclose(fragment_shader_file);
-    fragment_shader[fragment_shader_size] = '\0';
 
-    // initialize glew
-    GLenum glew_error = glewInit();
-    if (glew_error != GLEW_OK) {
-        printf("[glshell] error: unable to initialize GLEW\n");
+    init_glew();
+
+    // a baked loop costs a blit per frame, there is nothing left for the governor to scale
+    if (args.bake_loop > 0.0f && args.frame_budget > 0.0f) {
+        printf("[glshell] warning: --frame-budget has no effect with --bake-loop\n");
+        args.frame_budget = 0.0f;
+    }
+
+    // passes are built first, the program drawing the frame samples them
+    if (arrlen(args.passes) > 0) {
+        init_graph(&context, args.passes);
+    }
+    // headless frames are drawn back to back and every tick of an interval draws one, either
+    // way the feed is read often enough without writers waking glshell
+    if (args.feed != NULL) {
+        init_feed(&context, args.feed, !args.headless && args.interval == 0.0f);
+    }
+
+    // set up OpenGL. while watching, a shader that doesn't build yet may still be fixed
+    shader_load_info_t program_info = { 0 };
+    if (!init_gl(&context, fragment_shader, args.opaque, args.frame_budget, &program_info) &&
+        !args.watch) {
         exit(1);
     }
+    // images arriving after the first frame would show up in exported and baked frames, and in
+    // benchmark results
+    if (channels != NULL && (args.headless || args.bake_loop > 0.0f)) {
+        channels_wait(channels);
+    }
+    if (args.bake_loop > 0.0f) {
+        init_bake(
+            &context,
+            fragment_shader,
+            args.bake_loop,
+            args.bake_loop * args.fps + 0.5f,
+            args.bake_max_mb
+        );
+    }
+
+    // static shaders only need a new frame when the surface is reconfigured
+    bool animated = program_uses_time(&context);
+    if (!animated) {
+        printf("[glshell] shader does not use u_time, rendering on demand\n");
+        glshell_set_continuous(glshell, false);
+    }
+    if (context.feed != NULL) {
+        watch_feed(&context, animated);
+    }
+    // a status bar only has to change when its clock ticks, not on every vblank
+    if (args.interval > 0.0f) {
+        if (args.headless) {
+            printf("[glshell] warning: --interval has no effect with --headless\n");
+        } else {
+            printf("[glshell] redrawing every %g ms\n", args.interval);
+            glshell_set_interval(glshell, args.interval);
+        }
+    }
+
+    reloader_t* reloader = NULL;
+    if (args.watch) {
+        reloader = reloader_create(
+            glshell,
+            args.fragment_shader,
+            c_vertex_shader,
+            reload_program,
+            &context
+        );
+    }
+
+    exporter_t* exporter = NULL;
+    if (args.export_directory != NULL) {
+        export_format_t format;
+        if (!export_parse_format(args.format, &format)) {
+            printf("[glshell] error: unknown export format %s\n", args.format);
+            exit(1);
+        }
+        exporter = exporter_create(
+            args.export_directory,
+            format,
+            glshell_get_width(glshell),
+            glshell_get_height(glshell),
+            args.fps
+        );
+    }
+
+    // frame times and the CPU and GPU time of draw_frame(), only sampled with --stats as
+    // reading the thread clock is a syscall per call
+    frame_stats_t frame_stats;
+    if (args.stats) {
+        frame_stats_init(&frame_stats);
+    }
+    float loop_start = glshell_get_time(glshell);
+    float first_frame_ms = 0.0f;
+    int frame_count = 0;
+
+    // the compositor, the interval timer and the shader and image watches all wake
+    // glshell_get_fd(), signals wake signal_fd; one poll() sleeps until either has work.
+    // headless frames are drawn back to back and don't wait
+    struct pollfd pfds[2] = {
+        { .fd = glshell_get_fd(glshell), .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+    };
+
+    // draw exactly one frame per frame callback, nothing in between. with several surfaces
+    // each one is drawn as its own callback fires
+    while (glshell_flush(glshell)) {
+        if (poll(pfds, 2, args.headless ? 0 : -1) > 0 && (pfds[1].revents & POLLIN)) {
+            handle_signals(signal_fd, glshell);
+        }
+        if (!glshell_dispatch_pending(glshell)) {
+            break;
+        }
+        while (glshell_begin_frame(glshell)) {
+            // the governor and baked loops redraw the whole frame, partial damage is moot
+            if (args.has_damage && args.frame_budget == 0.0f && args.bake_loop == 0.0f) {
+                glshell_add_damage(
+                    glshell,
+                    args.damage[0],
+                    args.damage[1],
+                    args.damage[2],
+                    args.damage[3]
+                );
+            }
+            // exported frames are spaced evenly in time, however long they take to render
+            float time = exporter != NULL ? frame_count / args.fps : glshell_get_time(glshell);
+            if (args.stats) {
+                frame_stats_begin(&frame_stats);
+                draw_frame(&context, time);
+                frame_stats_end(&frame_stats);
+            } else {
+                draw_frame(&context, time);
+            }
+            if (exporter != NULL) {
+                exporter_capture(exporter, frame_count);
+            }
+            glshell_swap_buffers(glshell);
+
+            frame_count++;
+            if (frame_count == 1) {
+                first_frame_ms = glshell_get_time(glshell) * 1000.0f;
+            }
+            if ((args.frames > 0 && frame_count >= args.frames) ||
+                (args.duration > 0.0f &&
+                 glshell_get_time(glshell) - loop_start >= args.duration)) {
+                glshell_stop(glshell);
+            }
+        }
+    }
+
+    if (args.stats) {
+        glshell_stats_t stats;
+        glshell_get_stats(glshell, &stats);
+        printf(
+            "[glshell] stats: %" PRIu64 " frames, %" PRIu64 " wakeups in %.1f s "
+            "(%.2f wakeups/s)\n",
+            stats.frames,
+            stats.wakeups,
+            stats.elapsed,
+            stats.wakeups / stats.elapsed
+        );
+        printf(
+            "[glshell] stats: %.0f wakeups/h, %.2f s of CPU time/h\n",
+            stats.wakeups / stats.elapsed * 3600.0f,
+            stats.cpu_time / stats.elapsed * 3600.0f
+        );
+        if (stats.configures > 0) {
+            printf(
+                "[glshell] stats: %" PRIu64 " configures, answered after %.2f ms on average, "
+                "%.2f ms at most\n",
+                stats.configures,
+                stats.configure_latency_mean,
+                stats.configure_latency_max
+            );
+        }
+        float seconds = glshell_get_time(glshell) - loop_start;
+        printf("[glshell] stats: %.1f frames/s\n", frame_count / seconds);
+        printf("[glshell] stats: first frame %.2f ms after start\n", first_frame_ms);
+        frame_stats_print(&frame_stats);
+        if (channels != NULL) {
+            channels_print_stats(channels);
+        }
+        if (args.json != NULL) {
+            write_json(
+                args.json,
+                &args,
+                &program_info,
+                &frame_stats,
+                glshell,
+                &stats,
+                channels,
+                frame_count,
+                seconds,
+                first_frame_ms
+            );
+        }
+        frame_stats_destroy(&frame_stats);
+    }
+
+    bool exported = exporter == NULL || exporter_finish(exporter);
+
+    // the worker's shared context has to be released before the display goes away
+    if (reloader != NULL) {
+        reloader_destroy(reloader);
+    }
+    glshell_destroy(glshell);
+    close(signal_fd);
+
+    return exported ? 0 : 1;
+}
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// a value set over IPC, uploaded again to every new program of the overlay
+typedef struct overlay_uniform {
+    char* name;
+    int count;
+    float value[4];
+} overlay_uniform_t;
+
+// an overlay of the daemon, an instance of its own sharing the daemon's display
+typedef struct overlay {
+    char* name;
+    char* path;
+    // the params keep pointing at it, for outputs plugged in later
+    char* output_name;
+    gl_context_t context;
+    // stb_ds array
+    overlay_uniform_t* uniforms;
+} overlay_t;
+
+typedef struct daemon_state {
+    args_t* args;
+    // an instance without surfaces, which keeps the connection, the EGL context and the
+    // programs alive while no overlay exists
+    glshell_t* glshell;
+    // stb_ds array
+    overlay_t** overlays;
+    // the context draw_frame() last ran for, NULL once its GL state was changed
+    gl_context_t* bound;
+} daemon_state_t;
+
+static overlay_t* find_overlay(daemon_state_t* daemon_state, const char* name) {
+    for (size_t i = 0; i < arrlenu(daemon_state->overlays); i++) {
+        if (strcmp(daemon_state->overlays[i]->name, name) == 0) {
+            return daemon_state->overlays[i];
+        }
+    }
+    return NULL;
+}
+
+static void apply_uniforms(daemon_state_t* daemon_state, overlay_t* overlay) {
+    GLuint program = overlay->context.program;
+    if (program == 0 || arrlen(overlay->uniforms) == 0) {
+        return;
+    }
+    glUseProgram(program);
+    daemon_state->bound = NULL;
+    for (int i = 0; i < arrlen(overlay->uniforms); i++) {
+        overlay_uniform_t* uniform = &overlay->uniforms[i];
+        GLint location = glGetUniformLocation(program, uniform->name);
+        if (uniform->count == 1) {
+            glUniform1fv(location, 1, uniform->value);
+        } else if (uniform->count == 2) {
+            glUniform2fv(location, 1, uniform->value);
+        } else if (uniform->count == 3) {
+            glUniform3fv(location, 1, uniform->value);
+        } else {
+            glUniform4fv(location, 1, uniform->value);
+        }
+    }
+}
+
+static void overlay_destroy(daemon_state_t* daemon_state, overlay_t* overlay) {
+    for (size_t i = 0; i < arrlenu(daemon_state->overlays); i++) {
+        if (daemon_state->overlays[i] == overlay) {
+            arrdel(daemon_state->overlays, i);
+            break;
+        }
+    }
+    if (daemon_state->bound == &overlay->context) {
+        daemon_state->bound = NULL;
+    }
+
+    // the GL objects go first, the context stays current once the surfaces are gone too
+    glshell_t* glshell = overlay->context.glshell;
+    shutdown_gl(&overlay->context);
+    glshell_destroy(glshell);
+    for (int i = 0; i < arrlen(overlay->uniforms); i++) {
+        free(overlay->uniforms[i].name);
+    }
+    arrfree(overlay->uniforms);
+    free(overlay->output_name);
+    free(overlay->path);
+    free(overlay->name);
+    free(overlay);
+}
+
+// NULL with the reason in error if the overlay can't be created
+static overlay_t* overlay_create(
+    daemon_state_t* daemon_state,
+    const char* name,
+    const char* path,
+    args_t* args,
+    const char** error
+) {
+    double start = now_ms();
+    char* fragment_shader = read_shader(path);
+    if (fragment_shader == NULL) {
+        *error = "unable to open the fragment shader";
+        return NULL;
+    }
+
+    overlay_t* overlay = calloc(1, sizeof(overlay_t));
+    overlay->name = strdup(name);
+    overlay->path = strdup(path);
+    if (args->output_name != NULL) {
+        overlay->output_name = strdup(args->output_name);
+    }
+    glshell_params_t params = params_from_args(args);
+    params.output_name = overlay->output_name;
+    params.share = daemon_state->glshell;
+    glshell_t* glshell = glshell_create(&params);
+    if (glshell == NULL) {
+        *error = "output not found";
+        free(fragment_shader);
+        free(overlay->output_name);
+        free(overlay->path);
+        free(overlay->name);
+        free(overlay);
+        return NULL;
+    }
+    overlay->context.glshell = glshell;
+    arrput(daemon_state->overlays, overlay);
+
+    shader_load_info_t program_info = { 0 };
+    bool built = init_gl(&overlay->context, fragment_shader, args->opaque, 0.0f, &program_info);
+    free(fragment_shader);
+    daemon_state->bound = NULL;
+    if (!built) {
+        *error = "the fragment shader does not build";
+        overlay_destroy(daemon_state, overlay);
+        return NULL;
+    }
+    glshell_set_continuous(glshell, program_uses_time(&overlay->context));
+
+    printf("[glshell] %s: created from %s in %.2f ms\n", name, path, now_ms() - start);
+    return overlay;
+}
+
+// create <name> <path> [surface options], the options default to those the daemon was
+// started with
+static void command_create(
+    daemon_state_t* daemon_state,
+    ipc_client_t* client,
+    int argc,
+    char** argv
+) {
+    if (argc < 3) {
+        ipc_reply(client, "error usage: create <name> <path> [options]");
+        return;
+    }
+    if (find_overlay(daemon_state, argv[1]) != NULL) {
+        ipc_reply(client, "error %s already exists", argv[1]);
+        return;
+    }
+    args_t args = *daemon_state->args;
+    for (int i = 3; i < argc; i++) {
+        if (!args_parse_surface(&args, argc, argv, &i)) {
+            ipc_reply(client, "error invalid option %s", argv[i]);
+            return;
+        }
+    }
+
+    const char* error;
+    if (overlay_create(daemon_state, argv[1], argv[2], &args, &error) == NULL) {
+        ipc_reply(client, "error %s", error);
+        return;
+    }
+    ipc_reply(client, "ok");
+}
+
+// shader <name> <path>, the old program stays if the new one doesn't build
+static void command_shader(
+    daemon_state_t* daemon_state,
+    overlay_t* overlay,
+    ipc_client_t* client,
+    int argc,
+    char** argv
+) {
+    if (argc != 3) {
+        ipc_reply(client, "error usage: shader <name> <path>");
+        return;
+    }
+    double start = now_ms();
+    char* fragment_shader = read_shader(argv[2]);
+    if (fragment_shader == NULL) {
+        ipc_reply(client, "error unable to open the fragment shader");
+        return;
+    }
+    // through the program cache, a shader used before only has to be linked from its binary
+    GLuint program = shader_program_load(c_vertex_shader, fragment_shader, NULL);
+    if (program == 0) {
+        free(fragment_shader);
+        ipc_reply(client, "error the fragment shader does not build");
+        return;
+    }
+    free(overlay->path);
+    overlay->path = strdup(argv[2]);
+    reload_program(&overlay->context, program, fragment_shader);
+    apply_uniforms(daemon_state, overlay);
+    daemon_state->bound = NULL;
 
-    // set up OpenGL
-    init_gl(fragment_shader);
+    printf(
+        "[glshell] %s: switched to %s in %.2f ms\n",
+        overlay->name,
+        argv[2],
+        now_ms() - start
+    );
+    ipc_reply(client, "ok");
+}
 
-    bool running = true;
-    while (running) {
-        running = glshell_poll_events();
+// set <name> <uniform> <x> [<y> [<z> [<w>]]], a float, vec2, vec3 or vec4
+static void command_set(
+    daemon_state_t* daemon_state,
+    overlay_t* overlay,
+    ipc_client_t* client,
+    int argc,
+    char** argv
+) {
+    if (argc < 4 || argc > 7) {
+        ipc_reply(client, "error usage: set <name> <uniform> <x> [<y> [<z> [<w>]]]");
+        return;
+    }
+    overlay_uniform_t value = { .count = argc - 3 };
+    for (int i = 0; i < value.count; i++) {
+        char* end;
+        value.value[i] = strtof(argv[3 + i], &end);
+        if (end == argv[3 + i] || *end != '\0') {
+            ipc_reply(client, "error invalid value %s", argv[3 + i]);
+            return;
+        }
+    }
 
-        draw_frame();
+    overlay_uniform_t* uniform = NULL;
+    for (int i = 0; i < arrlen(overlay->uniforms); i++) {
+        if (strcmp(overlay->uniforms[i].name, argv[2]) == 0) {
+            uniform = &overlay->uniforms[i];
+        }
+    }
+    if (uniform == NULL) {
+        value.name = strdup(argv[2]);
+        arrput(overlay->uniforms, value);
+    } else {
+        value.name = uniform->name;
+        *uniform = value;
+    }
+    apply_uniforms(daemon_state, overlay);
+    // static shaders are drawn again for the new value, animated ones pick it up anyway
+    glshell_redraw(overlay->context.glshell);
+    ipc_reply(client, "ok");
+}
 
-        glshell_swap_buffers();
+// stats [<name>], of one overlay or of the whole daemon
+static void command_stats(
+    daemon_state_t* daemon_state,
+    ipc_client_t* client,
+    int argc,
+    char** argv
+) {
+    glshell_stats_t stats;
+    if (argc == 1) {
+        glshell_get_stats(daemon_state->glshell, &stats);
+        ipc_reply(
+            client,
+            "ok overlays=%zu seconds=%.1f wakeups=%" PRIu64 " cpu_seconds=%.2f",
+            arrlenu(daemon_state->overlays),
+            stats.elapsed,
+            stats.wakeups,
+            stats.cpu_time
+        );
+        return;
     }
+    overlay_t* overlay = find_overlay(daemon_state, argv[1]);
+    if (overlay == NULL) {
+        ipc_reply(client, "error no overlay %s", argv[1]);
+        return;
+    }
+    glshell_get_stats(overlay->context.glshell, &stats);
+    ipc_reply(
+        client,
+        "ok frames=%" PRIu64 " seconds=%.1f fps=%.1f configures=%" PRIu64
+        " configure_latency_mean_ms=%.2f configure_latency_max_ms=%.2f",
+        stats.frames,
+        stats.elapsed,
+        stats.frames / stats.elapsed,
+        stats.configures,
+        stats.configure_latency_mean,
+        stats.configure_latency_max
+    );
+}
 
-    glshell_cleanup();
+// from glshell_dispatch_pending(), between frames
+static void daemon_command(void* data, ipc_client_t* client, int argc, char** argv) {
+    daemon_state_t* daemon_state = data;
+    const char* command = argv[0];
+    if (strcmp(command, "create") == 0) {
+        command_create(daemon_state, client, argc, argv);
+        return;
+    } else if (strcmp(command, "stats") == 0) {
+        command_stats(daemon_state, client, argc, argv);
+        return;
+    } else if (strcmp(command, "list") == 0) {
+        char line[IPC_LINE_MAX] = "ok";
+        for (size_t i = 0; i < arrlenu(daemon_state->overlays); i++) {
+            overlay_t* overlay = daemon_state->overlays[i];
+            size_t length = strlen(line);
+            snprintf(line + length, sizeof(line) - length, " %s", overlay->name);
+        }
+        ipc_reply(client, "%s", line);
+        return;
+    } else if (strcmp(command, "stop") == 0) {
+        printf("[glshell] stopping\n");
+        glshell_stop(daemon_state->glshell);
+        ipc_reply(client, "ok");
+        return;
+    }
 
+    // the rest name an overlay
+    if (strcmp(command, "destroy") != 0 && strcmp(command, "shader") != 0 &&
+        strcmp(command, "set") != 0) {
+        ipc_reply(client, "error unknown command %s", command);
+        return;
+    }
+    overlay_t* overlay = argc > 1 ? find_overlay(daemon_state, argv[1]) : NULL;
+    if (overlay == NULL) {
+        ipc_reply(client, "error no overlay %s", argc > 1 ? argv[1] : "given");
+        return;
+    }
+    if (strcmp(command, "destroy") == 0) {
+        printf("[glshell] %s: destroyed\n", overlay->name);
+        overlay_destroy(daemon_state, overlay);
+        ipc_reply(client, "ok");
+    } else if (strcmp(command, "shader") == 0) {
+        command_shader(daemon_state, overlay, client, argc, argv);
+    } else {
+        command_set(daemon_state, overlay, client, argc, argv);
+    }
+}
+
+// --daemon: overlays are created, changed and destroyed over IPC, all of them drawn with one
+// context on one connection. switching a shader costs a compile, or a load from the program
+// cache, instead of a process start
+static int run_daemon(args_t* args, int signal_fd) {
+    if (arrlen(args->passes) > 0 || arrlen(args->channels) > 0 || args->feed != NULL ||
+        args->frame_budget > 0.0f || args->bake_loop > 0.0f || args->interval > 0.0f ||
+        args->watch || args->has_damage || args->stats) {
+        printf("[glshell] warning: only surface options apply to the daemon's overlays\n");
+    }
+
+    daemon_state_t daemon_state = { .args = args };
+    glshell_params_t params = params_from_args(args);
+    params.no_surfaces = true;
+    daemon_state.glshell = glshell_create(&params);
+    if (daemon_state.glshell == NULL) {
+        return 1;
+    }
+    init_glew();
+
+    const char* error;
+    if (args->fragment_shader != NULL &&
+        overlay_create(&daemon_state, "main", args->fragment_shader, args, &error) == NULL) {
+        printf("[glshell] error: %s: %s\n", args->fragment_shader, error);
+        exit(1);
+    }
+    ipc_server_t* server =
+        ipc_server_create(daemon_state.glshell, daemon_command, &daemon_state);
+
+    struct pollfd pfds[2] = {
+        { .fd = glshell_get_fd(daemon_state.glshell), .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+    };
+    // every overlay shares the display, so one flush and dispatch serves them all
+    while (glshell_flush(daemon_state.glshell)) {
+        if (poll(pfds, 2, -1) > 0 && (pfds[1].revents & POLLIN)) {
+            handle_signals(signal_fd, daemon_state.glshell);
+        }
+        if (!glshell_dispatch_pending(daemon_state.glshell)) {
+            break;
+        }
+        for (size_t i = 0; i < arrlenu(daemon_state.overlays); i++) {
+            overlay_t* overlay = daemon_state.overlays[i];
+            glshell_t* glshell = overlay->context.glshell;
+            while (glshell_begin_frame(glshell)) {
+                if (daemon_state.bound != &overlay->context) {
+                    bind_gl(&overlay->context);
+                    daemon_state.bound = &overlay->context;
+                }
+                draw_frame(&overlay->context, glshell_get_time(glshell));
+                glshell_swap_buffers(glshell);
+            }
+        }
+    }
+
+    ipc_server_destroy(server);
+    while (arrlenu(daemon_state.overlays) > 0) {
+        overlay_destroy(&daemon_state, daemon_state.overlays[0]);
+    }
+    arrfree(daemon_state.overlays);
+    glshell_destroy(daemon_state.glshell);
     return 0;
 }
 
+// a single triangle covering the whole viewport, generated from gl_VertexID so there is
+// no vertex or index data to fetch
 const char* c_vertex_shader =
     "#version 330 core\n"
     "\n"
-    "layout (location = 0) in vec3 pos;\n"
-    "layout (location = 1) in vec2 uv;\n"
-    "\n"
     "out vec2 texcoord;\n"
     "\n"
     "void main() {\n"
-    "    gl_Position = vec4(pos, 1.0);\n"
-    "    texcoord = uv;\n"
+    "    vec2 pos = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+    "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+    "    texcoord = vec2(pos.x * 0.5 + 0.5, 0.5 - pos.y * 0.5);\n"
     "}\n";
 
-struct vertex {
-    float pos[3];
-    float uv[2];
-} __attribute__((packed));
-
-static const struct vertex g_quad_vertices[] = {
-    { { -1.0f, -1.0f, 0.0f }, { 0.0f, 1.0f } },
-    { { 1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f } },
-    { { -1.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
-    { { 1.0f, 1.0f, 0.0f }, { 1.0f, 0.0f } },
-};
-
-static const uint16_t g_quad_indices[] = { 0, 1, 2, 2, 1, 3 };
-
-struct gl_context {
-    GLuint program;
-    GLuint vao;
-    GLuint vbo;
-} g_gl_context;
-
-void init_gl(const char* fragment_shader) {
+bool init_gl(
+    gl_context_t* context,
+    const char* fragment_shader,
+    bool opaque,
+    float frame_budget,
+    shader_load_info_t* program_info
+) {
     printf("[glshell] initializing OpenGL\n");
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    // set up multisampling
-    glEnable(GL_MULTISAMPLE);
+    if (!opaque) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // set up multisampling
+        glEnable(GL_MULTISAMPLE);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    // drawing is limited to the repaint region of each frame. the governor always redraws
+    // everything, and a scissor would also clip its blit
+    if (frame_budget > 0.0f) {
+        context->governor = malloc(sizeof(governor_t));
+        governor_init(context->governor, frame_budget);
+        printf("[glshell] frame budget %.2f ms of GPU time\n", frame_budget);
+    } else {
+        glEnable(GL_SCISSOR_TEST);
+    }
 
-    // create vertex array object
+    // core profiles need a vertex array object bound even without attributes
     GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
 
-    // create vertex buffer object
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    // upload vertex data
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_quad_vertices), g_quad_vertices, GL_STATIC_DRAW);
-
-    // set up vertex attributes
-    glVertexAttribPointer(
-        0,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        sizeof(struct vertex),
-        (void*)offsetof(struct vertex, pos)
-    );
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(
-        1,
-        2,
-        GL_FLOAT,
-        GL_FALSE,
-        sizeof(struct vertex),
-        (void*)offsetof(struct vertex, uv)
-    );
-    glEnableVertexAttribArray(1);
-
-    // create shader program
-    GLuint program = glCreateProgram();
-    GLint status;
-
-    // create vertex shader
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &c_vertex_shader, NULL);
-    glCompileShader(vs);
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE) {
-        GLint log_length;
-        glGetShaderiv(vs, GL_INFO_LOG_LENGTH, &log_length);
-        printf("[glshell] error: unable to compile vertex shader\n");
-        char* log = malloc(log_length);
-        glGetShaderInfoLog(vs, log_length, NULL, log);
-        printf("[glshell] error: %s\n", log);
-        free(log);
-        exit(1);
+    // set up the context
+    context->vao = vao;
+    context->opaque = opaque;
+
+    if (context->channels != NULL) {
+        channels_init_gl(context->channels, context->glshell);
     }
-    glAttachShader(program, vs);
-
-    // create fragment shader
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fragment_shader, NULL);
-    glCompileShader(fs);
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &status);
-    if (status != GL_TRUE) {
-        GLint log_length;
-        glGetShaderiv(fs, GL_INFO_LOG_LENGTH, &log_length);
-        printf("[glshell] error: unable to compile fragment shader\n");
-        char* log = malloc(log_length);
-        glGetShaderInfoLog(fs, log_length, NULL, log);
-        printf("[glshell] error: %s\n", log);
-        free(log);
-        exit(1);
+
+    // build shader program, from the binary cache if possible
+    GLuint program = shader_program_load(c_vertex_shader, fragment_shader, program_info);
+    if (program == 0) {
+        if (context->graph != NULL) {
+            graph_use_program(context->graph, 0);
+        }
+        return false;
     }
-    glAttachShader(program, fs);
+    use_program(context, program);
+    return true;
+}
 
-    // link program
-    glLinkProgram(program);
-    if (glGetError() != GL_NO_ERROR) {
-        printf("[glshell] error: unable to link program\n");
-        char log[512];
-        glGetProgramInfoLog(program, 512, NULL, log);
-        printf("[glshell] error: %s\n", log);
-        exit(1);
+channels_t* init_channels(gl_context_t* context, char** specs) {
+    context->channels = channels_load(specs);
+    return context->channels;
+}
+
+void init_graph(gl_context_t* context, char** passes) {
+    context->graph = calloc(1, sizeof(graph_t));
+    for (int i = 0; i < arrlen(passes); i++) {
+        graph_add_pass(context->graph, passes[i], c_vertex_shader);
     }
+}
 
-    // delete shaders
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+static void feed_woken(void* data) {
+    gl_context_t* context = data;
+    uint64_t updates;
+    if (read(context->feed->wakeup, &updates, sizeof(updates)) == -1) {
+        return;
+    }
+    // the frame and its passes are only drawn once a writer published
+    if (context->feed_wakes && feed_changed(context->feed)) {
+        glshell_redraw(context->glshell);
+    }
+}
 
-    // set up global context
-    g_gl_context.program = program;
-    g_gl_context.vao = vao;
-    g_gl_context.vbo = vbo;
+void init_feed(gl_context_t* context, const char* name, bool wake) {
+    context->feed = feed_open(name, wake);
+    if (wake) {
+        glshell_watch_fd(context->glshell, context->feed->wakeup, feed_woken, context);
+    }
 }
 
-void shutdown_gl(void) {
-    glDeleteProgram(g_gl_context.program);
-    glDeleteVertexArrays(1, &g_gl_context.vao);
-    glDeleteBuffers(1, &g_gl_context.vbo);
+// animated shaders read the feed on every frame they draw anyway, static ones that declare the
+// block are woken by writers instead of redrawing on every vblank
+void watch_feed(gl_context_t* context, bool animated) {
+    context->feed_wakes = context->feed_linked && !animated;
 }
 
-void draw_frame(void) {
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+// what baked frames are cached under, the passes and images change them as much as the shader
+static char* bake_source(gl_context_t* context, const char* fragment_shader) {
+    graph_t* graph = context->graph;
+    int pass_count = graph != NULL ? arrlen(graph->passes) : 0;
+    channels_t* channels = context->channels;
+    int channel_count = channels != NULL ? CHANNEL_COUNT : 0;
 
-    glBindVertexArray(g_gl_context.vao);
-    glUseProgram(g_gl_context.program);
-    glUniform1f(glGetUniformLocation(g_gl_context.program, "u_time"), glshell_get_time());
-    float resolution[2] = { glshell_get_width(), glshell_get_height() };
-    glUniform2fv(glGetUniformLocation(g_gl_context.program, "u_resolution"), 1, resolution);
+    size_t size = strlen(fragment_shader) + 1;
+    for (int i = 0; i < pass_count; i++) {
+        size += strlen(graph->passes[i].source);
+    }
+    // images by path, size and modification time, rather than reading them again
+    for (int i = 0; i < channel_count; i++) {
+        if (channels->channels[i].path != NULL) {
+            size += strlen(channels->channels[i].path) + 64;
+        }
+    }
 
-    // set up model matrix
+    char* source = malloc(size);
+    strcpy(source, fragment_shader);
+    for (int i = 0; i < pass_count; i++) {
+        strcat(source, graph->passes[i].source);
+    }
+    for (int i = 0; i < channel_count; i++) {
+        const char* path = channels->channels[i].path;
+        struct stat info;
+        if (path != NULL && stat(path, &info) == 0) {
+            char* end = source + strlen(source);
+            sprintf(
+                end,
+                "\n%d %s %lld %lld",
+                i,
+                path,
+                (long long)info.st_size,
+                (long long)info.st_mtime
+            );
+        }
+    }
+    return source;
+}
+
+void init_bake(
+    gl_context_t* context,
+    const char* fragment_shader,
+    float period,
+    int frames,
+    float max_mb
+) {
+    context->bake_shader = bake_source(context, fragment_shader);
+    context->bake_period = period;
+    context->bake_frames = frames > 0 ? frames : 1;
+    context->bake_max_bytes = max_mb * 1024.0 * 1024.0;
+
+    // every frame is a blit of the whole surface, which a scissor would clip
+    glDisable(GL_SCISSOR_TEST);
+}
+
+// replaces the program frames are drawn with
+void use_program(gl_context_t* context, GLuint program) {
+    glDeleteProgram(context->program);
+    glUseProgram(program);
+
+    context->program = program;
+    context->u_time = glGetUniformLocation(program, "u_time");
+    context->u_resolution = glGetUniformLocation(program, "u_resolution");
+    context->u_render_scale = glGetUniformLocation(program, "u_render_scale");
+    // uniforms start out at zero in a new program
+    context->resolution[0] = -1.0f;
+    context->resolution[1] = -1.0f;
+    context->render_scale = -1.0f;
+
+    graph_t* graph = context->graph;
+    if (graph != NULL) {
+        graph_use_program(graph, program);
+    }
+    if (context->channels != NULL) {
+        for (int i = 0; graph != NULL && i < arrlen(graph->passes); i++) {
+            graph->passes[i].channels =
+                channels_link(context->channels, graph->passes[i].program);
+        }
+        channels_link(context->channels, program);
+    }
+    feed_t* feed = context->feed;
+    if (feed != NULL) {
+        feed_reset(feed);
+        context->feed_linked = feed_link(feed, program);
+        for (int i = 0; graph != NULL && i < arrlen(graph->passes); i++) {
+            graph->passes[i].feed = feed_link(feed, graph->passes[i].program);
+            context->feed_linked |= graph->passes[i].feed;
+        }
+    }
+}
+
+// called from glshell_dispatch_pending() once a changed shader built, between frames
+void reload_program(void* data, GLuint program, char* fragment_shader) {
+    gl_context_t* context = data;
+    use_program(context, program);
+    bool animated = program_uses_time(context);
+    glshell_set_continuous(context->glshell, animated);
+    if (context->feed != NULL) {
+        watch_feed(context, animated);
+    }
+
+    // the baked frames are of the old shader
+    if (context->bake_shader != NULL) {
+        if (context->baked) {
+            bake_destroy(&context->bake);
+            context->baked = false;
+        }
+        free(context->bake_shader);
+        context->bake_shader = bake_source(context, fragment_shader);
+    }
+    free(fragment_shader);
+
+    glshell_redraw(context->glshell);
+}
+
+// passes that animate on their own and streams count too, as they change without the surface
+// changing. the feed doesn't, feed_woken() redraws once it changed
+bool program_uses_time(gl_context_t* context) {
+    if (context->program == 0) {
+        return false;
+    }
+    if (context->graph != NULL && graph_animated(context->graph)) {
+        return true;
+    }
+    if (context->channels != NULL && channels_animated(context->channels)) {
+        return true;
+    }
+    GLint uniform_count;
+    glGetProgramiv(context->program, GL_ACTIVE_UNIFORMS, &uniform_count);
+
+    // uniforms optimized out by the compiler are not active, so this is what the shader reads
+    for (GLint i = 0; i < uniform_count; i++) {
+        char name[64];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(context->program, i, sizeof(name), NULL, &size, &type, name);
+        if (strcmp(name, "u_time") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void shutdown_gl(gl_context_t* context) {
+    if (context->governor != NULL) {
+        governor_destroy(context->governor);
+        free(context->governor);
+        context->governor = NULL;
+    }
+    if (context->baked) {
+        bake_destroy(&context->bake);
+    }
+    free(context->bake_shader);
+    if (context->channels != NULL) {
+        channels_destroy(context->channels);
+        context->channels = NULL;
+    }
+    if (context->feed != NULL) {
+        if (context->feed->wakeup != -1) {
+            glshell_unwatch_fd(context->glshell, context->feed->wakeup);
+        }
+        feed_destroy(context->feed);
+        context->feed = NULL;
+    }
+    if (context->graph != NULL) {
+        graph_destroy(context->graph);
+        free(context->graph);
+        context->graph = NULL;
+    }
+    glDeleteProgram(context->program);
+    glDeleteVertexArrays(1, &context->vao);
+}
+
+void draw_shader(void* data, float time, int width, int height) {
+    gl_context_t* context = data;
+    // a watched shader that didn't build yet
+    if (context->program == 0) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        return;
+    }
+
+    float render_scale = context->governor != NULL ? context->governor->scale : 1.0f;
+
+    if (context->channels != NULL) {
+        channels_update(context->channels, time);
+    }
+    bool feed_updated = context->feed != NULL && feed_update(context->feed);
+    if (context->graph != NULL) {
+        if (context->channels != NULL) {
+            graph_invalidate_channels(context->graph, channels_take_changed(context->channels));
+        }
+        if (feed_updated) {
+            graph_invalidate_feed(context->graph);
+        }
+        graph_render(context->graph, time, width, height);
+    }
+
+    // the program and vertex array stay bound from init_gl(), only uniforms change. the clear
+    // is still needed as blending reads back the destination
+    if (!context->opaque) {
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    if (context->u_time != -1) {
+        glUniform1f(context->u_time, time);
+    }
+    if (context->resolution[0] != width || context->resolution[1] != height) {
+        context->resolution[0] = width;
+        context->resolution[1] = height;
+        glViewport(0, 0, width, height);
+        glUniform2fv(context->u_resolution, 1, context->resolution);
+    }
+    if (context->render_scale != render_scale) {
+        context->render_scale = render_scale;
+        glUniform1f(context->u_render_scale, render_scale);
+    }
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void draw_frame(gl_context_t* context, float time) {
+    float width = glshell_get_width(context->glshell);
+    float height = glshell_get_height(context->glshell);
+
+    if (context->bake_period > 0.0f && context->program != 0) {
+        // surfaces of other sizes get the frames scaled, rather than a bake each
+        if (!context->baked) {
+            context->baked = bake_create(
+                &context->bake,
+                context->bake_shader,
+                context->bake_period,
+                context->bake_frames,
+                width,
+                height,
+                context->bake_max_bytes
+            );
+            if (!context->baked) {
+                context->bake_period = 0.0f;
+            }
+        }
+        // a few frames are baked along with each one drawn, which is drawn live until the
+        // whole loop is
+        if (context->baked && bake_step(&context->bake, draw_shader, context)) {
+            bake_play(&context->bake, time, width, height);
+            return;
+        }
+    }
+
+    governor_t* governor = context->governor;
+    if (governor != NULL) {
+        governor_begin(governor, width, height);
+        draw_shader(context, time, governor->render_width, governor->render_height);
+        governor_end(governor, width, height);
+        return;
+    }
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, g_quad_indices);
+    glshell_rect_t region = glshell_get_repaint_region(context->glshell);
+    if (memcmp(&region, &context->scissor, sizeof(region)) != 0) {
+        context->scissor = region;
+        glScissor(region.x, region.y, region.width, region.height);
+    }
+    draw_shader(context, time, width, height);
+}
+
+// several contexts draw with the one GL context in daemon mode, and draw_frame() expects the
+// state it left bound. restores it for a context that didn't draw last
+void bind_gl(gl_context_t* context) {
+    glUseProgram(context->program);
+    glBindVertexArray(context->vao);
+    if (context->opaque) {
+        glDisable(GL_BLEND);
+    } else {
+        glEnable(GL_BLEND);
+    }
+    // the viewport and scissor box are set again by the next frame
+    context->resolution[0] = -1.0f;
+    context->resolution[1] = -1.0f;
+    context->scissor = (glshell_rect_t){ -1, -1, -1, -1 };
 }
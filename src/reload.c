@@ -0,0 +1,253 @@
+#include "reload.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "glshell.h"
+#include "shader.h"
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(size + 1);
+    size_t length = fread(data, 1, size, file);
+    data[length] = '\0';
+    fclose(file);
+    return data;
+}
+
+static GLuint build(reloader_t* reloader, const char* source) {
+    double start = now_ms();
+    GLuint program = shader_program_create(reloader->vertex_shader, source);
+    if (program == 0) {
+        printf("[glshell] reload failed, keeping the previous program\n");
+    } else {
+        printf("[glshell] reloaded %s in %.2f ms\n", reloader->path, now_ms() - start);
+    }
+    return program;
+}
+
+// on the render thread, which stops drawing until the driver is done
+static void reload_now(reloader_t* reloader, char* source) {
+    GLuint program = build(reloader, source);
+    if (program != 0) {
+        reloader->reload(reloader->data, program, source);
+    } else {
+        free(source);
+    }
+}
+
+static void* reload_worker(void* data) {
+    reloader_t* reloader = data;
+    uint64_t one = 1;
+    if (!glshell_make_shared_context_current(reloader->glshell)) {
+        printf(
+            "[glshell] warning: unable to use the shared context, building reloads on the "
+            "render thread\n"
+        );
+        // a change that came in already is picked up by reloader_program_ready()
+        pthread_mutex_lock(&reloader->mutex);
+        reloader->fallback = true;
+        write(reloader->event, &one, sizeof(one));
+        pthread_mutex_unlock(&reloader->mutex);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&reloader->mutex);
+    for (;;) {
+        while (reloader->source == NULL && !reloader->stop) {
+            pthread_cond_wait(&reloader->source_ready, &reloader->mutex);
+        }
+        if (reloader->stop) {
+            break;
+        }
+        char* source = reloader->source;
+        reloader->source = NULL;
+        pthread_mutex_unlock(&reloader->mutex);
+
+        GLuint program = build(reloader, source);
+        // objects changed in one context are only complete for the others once it finished
+        glFinish();
+
+        pthread_mutex_lock(&reloader->mutex);
+        if (program == 0) {
+            free(source);
+            continue;
+        }
+        // a program the render thread never picked up is superseded
+        if (reloader->program != 0) {
+            glDeleteProgram(reloader->program);
+            free(reloader->program_source);
+        }
+        reloader->program = program;
+        reloader->program_source = source;
+        write(reloader->event, &one, sizeof(one));
+    }
+    pthread_mutex_unlock(&reloader->mutex);
+
+    glshell_release_shared_context(reloader->glshell);
+    return NULL;
+}
+
+// on the render thread, from glshell_dispatch_pending()
+static void reloader_program_ready(void* data) {
+    reloader_t* reloader = data;
+    uint64_t count;
+    read(reloader->event, &count, sizeof(count));
+
+    pthread_mutex_lock(&reloader->mutex);
+    GLuint program = reloader->program;
+    char* source = reloader->program_source;
+    reloader->program = 0;
+    reloader->program_source = NULL;
+    char* pending = reloader->fallback ? reloader->source : NULL;
+    if (pending != NULL) {
+        reloader->source = NULL;
+    }
+    pthread_mutex_unlock(&reloader->mutex);
+
+    if (program != 0) {
+        reloader->reload(reloader->data, program, source);
+    }
+    if (pending != NULL) {
+        reload_now(reloader, pending);
+    }
+}
+
+static void reloader_file_changed(void* data) {
+    reloader_t* reloader = data;
+
+    // editors save in all sorts of ways, any write or replacement of the file counts
+    bool changed = false;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(reloader->inotify, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            if (event->len > 0 && strcmp(event->name, reloader->name) == 0) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+
+    char* source = read_file(reloader->path);
+    if (source == NULL) {
+        return;
+    }
+
+    if (!reloader->threaded) {
+        reload_now(reloader, source);
+        return;
+    }
+
+    // only the newest version is worth building
+    pthread_mutex_lock(&reloader->mutex);
+    bool fallback = reloader->fallback;
+    if (!fallback) {
+        free(reloader->source);
+        reloader->source = source;
+        pthread_cond_signal(&reloader->source_ready);
+    }
+    pthread_mutex_unlock(&reloader->mutex);
+    if (fallback) {
+        reload_now(reloader, source);
+    }
+}
+
+reloader_t* reloader_create(
+    glshell_t* glshell,
+    const char* path,
+    const char* vertex_shader,
+    reload_fn reload,
+    void* data
+) {
+    reloader_t* reloader = calloc(1, sizeof(reloader_t));
+    reloader->glshell = glshell;
+    reloader->path = strdup(path);
+    reloader->vertex_shader = vertex_shader;
+    reloader->reload = reload;
+    reloader->data = data;
+
+    // watch the directory rather than the file, which editors often replace with a new one
+    char* directory = strdup(path);
+    char* slash = strrchr(directory, '/');
+    if (slash == NULL) {
+        reloader->name = strdup(path);
+        strcpy(directory, ".");
+    } else {
+        reloader->name = strdup(slash + 1);
+        *(slash == directory ? slash + 1 : slash) = '\0';
+    }
+
+    reloader->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reloader->inotify == -1 ||
+        inotify_add_watch(reloader->inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        printf("[glshell] error: unable to watch %s: %s\n", directory, strerror(errno));
+        exit(1);
+    }
+    free(directory);
+    glshell_watch_fd(glshell, reloader->inotify, reloader_file_changed, reloader);
+
+    reloader->threaded = glshell_create_shared_context(glshell);
+    if (reloader->threaded) {
+        reloader->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        pthread_mutex_init(&reloader->mutex, NULL);
+        pthread_cond_init(&reloader->source_ready, NULL);
+        pthread_create(&reloader->thread, NULL, reload_worker, reloader);
+        glshell_watch_fd(glshell, reloader->event, reloader_program_ready, reloader);
+    } else {
+        printf("[glshell] warning: no shared context, building reloads on the render thread\n");
+    }
+
+    printf("[glshell] watching %s for changes\n", path);
+    return reloader;
+}
+
+void reloader_destroy(reloader_t* reloader) {
+    if (reloader->threaded) {
+        pthread_mutex_lock(&reloader->mutex);
+        reloader->stop = true;
+        pthread_cond_signal(&reloader->source_ready);
+        pthread_mutex_unlock(&reloader->mutex);
+        pthread_join(reloader->thread, NULL);
+
+        if (reloader->program != 0) {
+            glDeleteProgram(reloader->program);
+        }
+        free(reloader->program_source);
+        free(reloader->source);
+        pthread_mutex_destroy(&reloader->mutex);
+        pthread_cond_destroy(&reloader->source_ready);
+        glshell_unwatch_fd(reloader->glshell, reloader->event);
+        close(reloader->event);
+    }
+
+    glshell_unwatch_fd(reloader->glshell, reloader->inotify);
+    close(reloader->inotify);
+    free(reloader->name);
+    free(reloader->path);
+    free(reloader);
+}
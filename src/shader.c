@@ -0,0 +1,230 @@
+#include "shader.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+
+#define PROGRAM_BINARY_MAGIC "GLSHBIN1"
+
+struct program_binary_header {
+    char magic[8];
+    uint64_t key;
+    GLenum format;
+    GLint length;
+    // how long building from source took, to report what the cache saved
+    float compile_ms;
+};
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static GLuint compile_shader(GLenum type, const char* source, const char* kind) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint log_length;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
+        printf("[glshell] error: unable to compile %s shader\n", kind);
+        char* log = malloc(log_length + 1);
+        log[0] = '\0';
+        glGetShaderInfoLog(shader, log_length + 1, NULL, log);
+        printf("[glshell] error: %s\n", log);
+        free(log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static bool program_linked(GLuint program) {
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+static bool binary_cache_supported(void) {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+GLuint shader_program_create(const char* vertex_shader, const char* fragment_shader) {
+    GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_shader, "vertex");
+    if (vs == 0) {
+        return 0;
+    }
+    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader, "fragment");
+    if (fs == 0) {
+        glDeleteShader(vs);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    if (binary_cache_supported()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+
+    // the program keeps what it needs, the shaders are only flagged for deletion
+    glDetachShader(program, vs);
+    glDetachShader(program, fs);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    if (!program_linked(program)) {
+        printf("[glshell] error: unable to link program\n");
+        char log[512];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        printf("[glshell] error: %s\n", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static uint64_t program_key(const char* vertex_shader, const char* fragment_shader) {
+    // a binary is only valid for the exact sources on the exact driver build that produced it
+    uint64_t key = CACHE_HASH_INIT;
+    key = cache_hash_string(key, vertex_shader);
+    key = cache_hash_string(key, fragment_shader);
+    key = cache_hash_string(key, (const char*)glGetString(GL_VENDOR));
+    key = cache_hash_string(key, (const char*)glGetString(GL_RENDERER));
+    key = cache_hash_string(key, (const char*)glGetString(GL_VERSION));
+    return key;
+}
+
+static GLuint program_from_cache(const char* name, uint64_t key, float* compile_ms) {
+    size_t size;
+    uint8_t* data = cache_read(name, &size);
+    if (data == NULL) {
+        return 0;
+    }
+
+    struct program_binary_header header;
+    if (size < sizeof(header)) {
+        free(data);
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.key != key || header.length <= 0 ||
+        (size_t)header.length != size - sizeof(header)) {
+        free(data);
+        return 0;
+    }
+
+    // drivers reject binaries from other versions with a link failure, not an error
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, data + sizeof(header), header.length);
+    free(data);
+    if (!program_linked(program)) {
+        printf("[glshell] cached program binary rejected by the driver\n");
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    *compile_ms = header.compile_ms;
+    return program;
+}
+
+static void program_to_cache(GLuint program, const char* name, uint64_t key, float compile_ms) {
+    struct program_binary_header header = {
+        .key = key,
+        .compile_ms = compile_ms,
+    };
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+    if (header.length <= 0) {
+        return;
+    }
+
+    uint8_t* data = malloc(sizeof(header) + header.length);
+    glGetProgramBinary(
+        program,
+        header.length,
+        &header.length,
+        &header.format,
+        data + sizeof(header)
+    );
+    memcpy(data, &header, sizeof(header));
+
+    if (!cache_write(name, data, sizeof(header) + header.length)) {
+        printf("[glshell] warning: unable to write program binary cache\n");
+    }
+    free(data);
+}
+
+GLuint shader_program_load(
+    const char* vertex_shader,
+    const char* fragment_shader,
+    shader_load_info_t* info
+) {
+    double start = now_ms();
+    shader_load_info_t load_info = { 0 };
+
+    bool use_cache = binary_cache_supported();
+    uint64_t key = 0;
+    char name[32];
+    if (use_cache) {
+        key = program_key(vertex_shader, fragment_shader);
+        snprintf(name, sizeof(name), "%016" PRIx64 ".bin", key);
+
+        float compile_ms;
+        GLuint program = program_from_cache(name, key, &compile_ms);
+        if (program != 0) {
+            load_info.load_ms = now_ms() - start;
+            load_info.compile_ms = compile_ms;
+            load_info.cached = true;
+            printf(
+                "[glshell] program loaded from cache in %.2f ms (compiling took %.2f ms)\n",
+                load_info.load_ms,
+                compile_ms
+            );
+            if (info != NULL) {
+                *info = load_info;
+            }
+            return program;
+        }
+    }
+
+    GLuint program = shader_program_create(vertex_shader, fragment_shader);
+    if (program == 0) {
+        if (info != NULL) {
+            *info = load_info;
+        }
+        return 0;
+    }
+
+    float compile_ms = now_ms() - start;
+    printf("[glshell] program compiled in %.2f ms\n", compile_ms);
+
+    if (use_cache) {
+        program_to_cache(program, name, key, compile_ms);
+    }
+
+    load_info.load_ms = now_ms() - start;
+    load_info.compile_ms = compile_ms;
+    if (info != NULL) {
+        *info = load_info;
+    }
+    return program;
+}
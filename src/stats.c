@@ -0,0 +1,170 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stb_ds.h"
+
+static double monotonic_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+// CPU time of this thread only, so time spent blocked in the driver doesn't count
+static double thread_cpu_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+void frame_stats_init(frame_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    glGenQueries(2 * FRAME_STATS_QUERIES, &stats->queries[0][0]);
+}
+
+void frame_stats_destroy(frame_stats_t* stats) {
+    glDeleteQueries(2 * FRAME_STATS_QUERIES, &stats->queries[0][0]);
+    arrfree(stats->frame_times);
+    arrfree(stats->cpu_times);
+    arrfree(stats->gpu_times);
+}
+
+static void frame_stats_collect(frame_stats_t* stats, bool wait) {
+    while (stats->query_count > 0) {
+        GLuint* queries = stats->queries[stats->query_first];
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+        }
+
+        GLuint64 start, end;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+        arrput(stats->gpu_times, (end - start) / 1000000.0f);
+
+        stats->query_first = (stats->query_first + 1) % FRAME_STATS_QUERIES;
+        stats->query_count--;
+    }
+}
+
+void frame_stats_begin(frame_stats_t* stats) {
+    double now = monotonic_time();
+    if (stats->last_frame != 0.0) {
+        arrput(stats->frame_times, (now - stats->last_frame) * 1000.0f);
+    }
+    stats->last_frame = now;
+
+    frame_stats_collect(stats, false);
+
+    // with every query pending the GPU side of this frame goes unmeasured
+    if (stats->query_count < FRAME_STATS_QUERIES) {
+        int index = (stats->query_first + stats->query_count) % FRAME_STATS_QUERIES;
+        glQueryCounter(stats->queries[index][0], GL_TIMESTAMP);
+        stats->query_active = true;
+    }
+    stats->cpu_start = thread_cpu_time();
+}
+
+void frame_stats_end(frame_stats_t* stats) {
+    arrput(stats->cpu_times, (thread_cpu_time() - stats->cpu_start) * 1000.0f);
+
+    if (stats->query_active) {
+        int index = (stats->query_first + stats->query_count) % FRAME_STATS_QUERIES;
+        glQueryCounter(stats->queries[index][1], GL_TIMESTAMP);
+        stats->query_count++;
+        stats->query_active = false;
+    }
+}
+
+static int compare_float(const void* a, const void* b) {
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+struct summary {
+    double mean;
+    float p50;
+    float p95;
+    float p99;
+    float max;
+};
+
+// sorts the samples in place, so percentiles are nearest rank
+static bool summarize(float* times, struct summary* summary) {
+    size_t count = arrlenu(times);
+    if (count == 0) {
+        return false;
+    }
+
+    qsort(times, count, sizeof(float), compare_float);
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        sum += times[i];
+    }
+    summary->mean = sum / count;
+    summary->p50 = times[(count - 1) * 50 / 100];
+    summary->p95 = times[(count - 1) * 95 / 100];
+    summary->p99 = times[(count - 1) * 99 / 100];
+    summary->max = times[count - 1];
+    return true;
+}
+
+static void print_summary(const char* name, float* times) {
+    struct summary summary;
+    if (!summarize(times, &summary)) {
+        printf("[glshell] stats: %s time: no samples\n", name);
+        return;
+    }
+
+    printf(
+        "[glshell] stats: %s ms: mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+        name,
+        summary.mean,
+        summary.p50,
+        summary.p95,
+        summary.p99,
+        summary.max
+    );
+}
+
+static void write_summary(FILE* file, const char* name, float* times) {
+    struct summary summary;
+    if (!summarize(times, &summary)) {
+        fprintf(file, "\"%s\": null", name);
+        return;
+    }
+
+    fprintf(
+        file,
+        "\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+        name,
+        summary.mean,
+        summary.p50,
+        summary.p95,
+        summary.p99,
+        summary.max
+    );
+}
+
+void frame_stats_print(frame_stats_t* stats) {
+    frame_stats_collect(stats, true);
+    print_summary("frame time", stats->frame_times);
+    print_summary("draw_frame() CPU", stats->cpu_times);
+    print_summary("draw_frame() GPU", stats->gpu_times);
+}
+
+void frame_stats_write_json(frame_stats_t* stats, FILE* file) {
+    frame_stats_collect(stats, true);
+    write_summary(file, "frame_ms", stats->frame_times);
+    fprintf(file, ", ");
+    write_summary(file, "cpu_ms", stats->cpu_times);
+    fprintf(file, ", ");
+    write_summary(file, "gpu_ms", stats->gpu_times);
+}
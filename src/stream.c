@@ -0,0 +1,565 @@
+#include "stream.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "stb_ds.h"
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// widest frame number a sequence pattern may ask for
+#define STREAM_MAX_DIGITS 16
+
+static bool is_y4m(const char* path) {
+    size_t length = strlen(path);
+    return length > 4 && strcmp(path + length - 4, ".y4m") == 0;
+}
+
+// splits an image sequence pattern around its frame number. the path is only ever read, never
+// used as a format: anything but one %d, %<width>d or %0<width>d and any number of %% makes it
+// a plain file name. prefix and suffix are set and owned by the caller if it returns true
+static bool parse_sequence(
+    const char* pattern,
+    char** prefix,
+    char** suffix,
+    int* digits,
+    bool* zero_pad
+) {
+    size_t length = strlen(pattern);
+    char* parts[2] = { malloc(length + 1), malloc(length + 1) };
+    size_t lengths[2] = { 0, 0 };
+    int part = 0;
+    bool valid = true;
+    *digits = 0;
+    *zero_pad = false;
+
+    for (const char* p = pattern; valid && *p != '\0'; p++) {
+        if (*p != '%') {
+            parts[part][lengths[part]++] = *p;
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            parts[part][lengths[part]++] = '%';
+            continue;
+        }
+        // a second conversion
+        if (part == 1) {
+            valid = false;
+            break;
+        }
+        if (*p == '0') {
+            *zero_pad = true;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9' && *digits <= STREAM_MAX_DIGITS) {
+            *digits = *digits * 10 + (*p - '0');
+            p++;
+        }
+        valid = *p == 'd' && *digits <= STREAM_MAX_DIGITS;
+        part = 1;
+    }
+
+    if (!valid || part == 0) {
+        free(parts[0]);
+        free(parts[1]);
+        return false;
+    }
+    parts[0][lengths[0]] = '\0';
+    parts[1][lengths[1]] = '\0';
+    *prefix = parts[0];
+    *suffix = parts[1];
+    return true;
+}
+
+bool stream_is_stream(const char* path) {
+    if (is_y4m(path)) {
+        return true;
+    }
+    char* prefix;
+    char* suffix;
+    int digits;
+    bool zero_pad;
+    if (!parse_sequence(path, &prefix, &suffix, &digits, &zero_pad)) {
+        return false;
+    }
+    free(prefix);
+    free(suffix);
+    return true;
+}
+
+static void* map_file(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat info;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = info.st_size;
+    return data;
+}
+
+// the header and frame headers are lines of space separated fields, only the planes in between
+// are read when decoding
+static bool open_y4m(stream_t* stream) {
+    stream->data = map_file(stream->path, &stream->size);
+    if (stream->data == NULL) {
+        return false;
+    }
+    const char* data = (const char*)stream->data;
+    const char* end = memchr(data, '\n', stream->size);
+    if (end == NULL || strncmp(data, "YUV4MPEG2 ", 10) != 0) {
+        return false;
+    }
+
+    int rate = 0;
+    int scale = 1;
+    char chroma[16] = "420jpeg";
+    for (const char* field = data + 9; field < end; field++) {
+        if (*field != ' ') {
+            continue;
+        }
+        switch (field[1]) {
+            case 'W':
+                stream->width = atoi(field + 2);
+                break;
+            case 'H':
+                stream->height = atoi(field + 2);
+                break;
+            case 'F':
+                sscanf(field + 2, "%d:%d", &rate, &scale);
+                break;
+            case 'C':
+                sscanf(field + 2, "%15s", chroma);
+                break;
+        }
+    }
+    if (stream->width <= 0 || stream->height <= 0 || rate <= 0 || scale <= 0) {
+        return false;
+    }
+    stream->fps = (float)rate / scale;
+
+    // every 4:2:0 siting shares a layout
+    if (strncmp(chroma, "420", 3) == 0) {
+        stream->chroma_width = (stream->width + 1) / 2;
+        stream->chroma_height = (stream->height + 1) / 2;
+    } else if (strcmp(chroma, "422") == 0) {
+        stream->chroma_width = (stream->width + 1) / 2;
+        stream->chroma_height = stream->height;
+    } else if (strcmp(chroma, "444") == 0) {
+        stream->chroma_width = stream->width;
+        stream->chroma_height = stream->height;
+    } else {
+        printf("[glshell] error: %s: unsupported chroma format %s\n", stream->path, chroma);
+        exit(1);
+    }
+
+    size_t planes = (size_t)stream->width * stream->height +
+                    2 * (size_t)stream->chroma_width * stream->chroma_height;
+    size_t offset = end + 1 - data;
+    while (offset + 5 < stream->size && strncmp(data + offset, "FRAME", 5) == 0) {
+        const char* line_end = memchr(data + offset, '\n', stream->size - offset);
+        if (line_end == NULL) {
+            break;
+        }
+        offset = line_end + 1 - data;
+        if (offset + planes > stream->size) {
+            break;
+        }
+        arrput(stream->frames, offset);
+        offset += planes;
+    }
+    stream->frame_count = arrlen(stream->frames);
+    return true;
+}
+
+// the file holding frame n of an image sequence, counted from the first
+static void sequence_path(stream_t* stream, int n, char* path, size_t size) {
+    snprintf(
+        path,
+        size,
+        stream->zero_pad ? "%s%0*d%s" : "%s%*d%s",
+        stream->prefix,
+        stream->digits,
+        stream->first + n,
+        stream->suffix
+    );
+}
+
+static bool open_sequence(stream_t* stream) {
+    if (!parse_sequence(
+            stream->path,
+            &stream->prefix,
+            &stream->suffix,
+            &stream->digits,
+            &stream->zero_pad
+        )) {
+        return false;
+    }
+
+    char path[4096];
+    // numbering starts at 0 or 1
+    for (stream->first = 0; stream->first < 2; stream->first++) {
+        sequence_path(stream, 0, path, sizeof(path));
+        if (access(path, R_OK) == 0) {
+            break;
+        }
+    }
+    for (;;) {
+        sequence_path(stream, stream->frame_count, path, sizeof(path));
+        if (access(path, R_OK) != 0) {
+            break;
+        }
+        stream->frame_count++;
+    }
+    if (stream->frame_count == 0) {
+        return false;
+    }
+
+    sequence_path(stream, 0, path, sizeof(path));
+    if (!image_info(path, &stream->width, &stream->height)) {
+        return false;
+    }
+    // image sequences have no rate of their own
+    stream->fps = 30.0f;
+    return true;
+}
+
+stream_t* stream_open(const char* path) {
+    stream_t* stream = calloc(1, sizeof(stream_t));
+    stream->path = strdup(path);
+
+    bool ok = is_y4m(path) ? open_y4m(stream) : open_sequence(stream);
+    if (!ok || stream->frame_count == 0) {
+        printf("[glshell] error: unable to read frames from %s\n", path);
+        exit(1);
+    }
+
+    printf(
+        "[glshell] streaming %s: %d frames, %dx%d at %.2f fps\n",
+        path,
+        stream->frame_count,
+        stream->width,
+        stream->height,
+        stream->fps
+    );
+    return stream;
+}
+
+static unsigned char clamp_byte(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// full range BT.601, the inverse of what --export writes
+static void convert_y4m(stream_t* stream, int frame, unsigned char* out) {
+    const unsigned char* luma = stream->data + stream->frames[frame];
+    const unsigned char* cb = luma + (size_t)stream->width * stream->height;
+    const unsigned char* cr = cb + (size_t)stream->chroma_width * stream->chroma_height;
+    int shift_x = stream->chroma_width < stream->width ? 1 : 0;
+    int shift_y = stream->chroma_height < stream->height ? 1 : 0;
+
+    for (int y = 0; y < stream->height; y++) {
+        const unsigned char* luma_row = luma + (size_t)y * stream->width;
+        size_t chroma_row = (size_t)(y >> shift_y) * stream->chroma_width;
+        for (int x = 0; x < stream->width; x++) {
+            int l = luma_row[x] << 16;
+            int u = cb[chroma_row + (x >> shift_x)] - 128;
+            int v = cr[chroma_row + (x >> shift_x)] - 128;
+            out[0] = clamp_byte((l + 91881 * v + 32768) >> 16);
+            out[1] = clamp_byte((l - 22554 * u - 46802 * v + 32768) >> 16);
+            out[2] = clamp_byte((l + 116130 * u + 32768) >> 16);
+            out[3] = 255;
+            out += 4;
+        }
+    }
+}
+
+static bool decode_image(stream_t* stream, int frame, unsigned char* out) {
+    char path[4096];
+    sequence_path(stream, frame, path, sizeof(path));
+    size_t size;
+    unsigned char* data = map_file(path, &size);
+    if (data == NULL) {
+        return false;
+    }
+    int width;
+    int height;
+    const char* error;
+    unsigned char* pixels = image_load_from_memory(data, size, &width, &height, &error);
+    munmap(data, size);
+    if (pixels == NULL || width != stream->width || height != stream->height) {
+        image_free(pixels);
+        return false;
+    }
+    memcpy(out, pixels, stream->slot_size);
+    image_free(pixels);
+    return true;
+}
+
+static void* stream_worker(void* data) {
+    stream_t* stream = data;
+
+    pthread_mutex_lock(&stream->mutex);
+    while (!stream->stop) {
+        stream_slot_t* slot = NULL;
+        for (int i = 0; i < STREAM_SLOTS && slot == NULL; i++) {
+            if (stream->slots[i].state == STREAM_SLOT_FREE) {
+                slot = &stream->slots[i];
+            }
+        }
+        if (slot == NULL) {
+            pthread_cond_wait(&stream->work, &stream->mutex);
+            continue;
+        }
+
+        // frames that are already late are skipped rather than decoded
+        if (stream->next < stream->target) {
+            stream->drops += stream->target - stream->next;
+            stream->next = stream->target;
+        }
+        int64_t frame = stream->next++;
+        slot->state = STREAM_SLOT_DECODING;
+        slot->frame = frame;
+        pthread_mutex_unlock(&stream->mutex);
+
+        int file_frame = frame % stream->frame_count;
+        if (stream->frames != NULL) {
+            convert_y4m(stream, file_frame, slot->pixels);
+        } else if (!decode_image(stream, file_frame, slot->pixels)) {
+            // shown black, so frames stay in step
+            printf("[glshell] warning: %s: can't decode frame %d\n", stream->path, file_frame);
+            memset(slot->pixels, 0, stream->slot_size);
+        }
+
+        pthread_mutex_lock(&stream->mutex);
+        slot->state = STREAM_SLOT_READY;
+        pthread_cond_signal(&stream->ready);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+void stream_start(stream_t* stream, int unit) {
+    stream->slot_size = (size_t)stream->width * stream->height * 4;
+    stream->uploaded = -1;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glGenTextures(1, &stream->texture);
+    glBindTexture(GL_TEXTURE_2D, stream->texture);
+    glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA8,
+        stream->width,
+        stream->height,
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        NULL
+    );
+    // a new mipmap chain for every frame would cost more than the upload
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glActiveTexture(GL_TEXTURE0);
+
+    // the worker writes straight into buffer memory the GPU copies from. without persistent
+    // mappings, frames are uploaded from ordinary memory instead
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        size_t size = stream->slot_size * STREAM_SLOTS;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &stream->buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream->buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        unsigned char* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (int i = 0; i < STREAM_SLOTS; i++) {
+            stream->slots[i].pixels = mapped + i * stream->slot_size;
+        }
+    } else {
+        for (int i = 0; i < STREAM_SLOTS; i++) {
+            stream->slots[i].pixels = malloc(stream->slot_size);
+        }
+    }
+
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->work, NULL);
+    pthread_cond_init(&stream->ready, NULL);
+    pthread_create(&stream->thread, NULL, stream_worker, stream);
+}
+
+// with the mutex held
+static void release_uploaded(stream_t* stream, GLuint64 timeout) {
+    for (int i = 0; i < STREAM_SLOTS; i++) {
+        stream_slot_t* slot = &stream->slots[i];
+        if (slot->state != STREAM_SLOT_UPLOADING) {
+            continue;
+        }
+        GLenum status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(slot->fence);
+            slot->state = STREAM_SLOT_FREE;
+            pthread_cond_signal(&stream->work);
+        }
+    }
+}
+
+// the newest ready frame that is due, dropping the ones before it. with the mutex held
+static stream_slot_t* take_ready(stream_t* stream) {
+    stream_slot_t* newest = NULL;
+    for (int i = 0; i < STREAM_SLOTS; i++) {
+        stream_slot_t* slot = &stream->slots[i];
+        if (slot->state == STREAM_SLOT_READY && slot->frame <= stream->target &&
+            (newest == NULL || slot->frame > newest->frame)) {
+            newest = slot;
+        }
+    }
+    for (int i = 0; i < STREAM_SLOTS && newest != NULL; i++) {
+        stream_slot_t* slot = &stream->slots[i];
+        if (slot->state == STREAM_SLOT_READY && slot->frame < newest->frame) {
+            slot->state = STREAM_SLOT_FREE;
+            stream->drops++;
+            pthread_cond_signal(&stream->work);
+        }
+    }
+    return newest;
+}
+
+bool stream_update(stream_t* stream, float time, int unit) {
+    int64_t target = time > 0.0f ? (int64_t)(time * stream->fps) : 0;
+
+    pthread_mutex_lock(&stream->mutex);
+    // time went back, e.g. to bake a loop: whatever was decoded ahead is of no use
+    if (target < stream->uploaded) {
+        for (int i = 0; i < STREAM_SLOTS; i++) {
+            if (stream->slots[i].state == STREAM_SLOT_READY) {
+                stream->slots[i].state = STREAM_SLOT_FREE;
+            }
+        }
+        stream->next = target;
+        stream->uploaded = -1;
+    }
+    stream->target = target;
+    pthread_cond_signal(&stream->work);
+
+    release_uploaded(stream, 0);
+    stream_slot_t* slot = take_ready(stream);
+    if (stream->blocking) {
+        while (stream->uploaded != target && (slot == NULL || slot->frame != target)) {
+            release_uploaded(stream, GL_TIMEOUT_IGNORED);
+            pthread_cond_wait(&stream->ready, &stream->mutex);
+            slot = take_ready(stream);
+        }
+    }
+    if (slot == NULL || slot->frame == stream->uploaded) {
+        pthread_mutex_unlock(&stream->mutex);
+        return false;
+    }
+    slot->state = STREAM_SLOT_UPLOADING;
+    pthread_mutex_unlock(&stream->mutex);
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    if (stream->buffer != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream->buffer);
+        glTexSubImage2D(
+            GL_TEXTURE_2D,
+            0,
+            0,
+            0,
+            stream->width,
+            stream->height,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            (void*)(uintptr_t)(slot->pixels - stream->slots[0].pixels)
+        );
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        glTexSubImage2D(
+            GL_TEXTURE_2D,
+            0,
+            0,
+            0,
+            stream->width,
+            stream->height,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            slot->pixels
+        );
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    pthread_mutex_lock(&stream->mutex);
+    // ordinary memory is copied before glTexSubImage2D returns
+    if (stream->buffer != 0) {
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    } else {
+        slot->state = STREAM_SLOT_FREE;
+        pthread_cond_signal(&stream->work);
+    }
+    stream->uploaded = slot->frame;
+    stream->uploads++;
+    stream->last_upload = now_ms();
+    if (stream->uploads == 1) {
+        stream->first_upload = stream->last_upload;
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return true;
+}
+
+void stream_destroy(stream_t* stream) {
+    if (stream->texture != 0) {
+        pthread_mutex_lock(&stream->mutex);
+        stream->stop = true;
+        pthread_cond_signal(&stream->work);
+        pthread_mutex_unlock(&stream->mutex);
+        pthread_join(stream->thread, NULL);
+
+        for (int i = 0; i < STREAM_SLOTS; i++) {
+            if (stream->slots[i].state == STREAM_SLOT_UPLOADING) {
+                glDeleteSync(stream->slots[i].fence);
+            }
+            if (stream->buffer == 0) {
+                free(stream->slots[i].pixels);
+            }
+        }
+        if (stream->buffer != 0) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream->buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &stream->buffer);
+        }
+        glDeleteTextures(1, &stream->texture);
+        pthread_mutex_destroy(&stream->mutex);
+        pthread_cond_destroy(&stream->work);
+        pthread_cond_destroy(&stream->ready);
+    }
+
+    if (stream->data != NULL) {
+        munmap(stream->data, stream->size);
+    }
+    arrfree(stream->frames);
+    free(stream->prefix);
+    free(stream->suffix);
+    free(stream->path);
+    free(stream);
+}